@@ -0,0 +1,100 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+// Blocks form a chain; the ones past `current` were used once and are
+// handed out again before anything new is malloc'd
+struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t used;
+    size_t size;
+    max_align_t data[]; // aligned for anything
+};
+
+static void arena_out_of_memory(void)
+{
+    fprintf(stderr, "Memory allocation failed in arena\n");
+    exit(EXIT_FAILURE);
+}
+
+void arena_init(Arena *arena)
+{
+    arena->first = NULL;
+    arena->current = NULL;
+}
+
+void arena_destroy(Arena *arena)
+{
+    ArenaBlock *block = arena->first;
+    while (block)
+    {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
+
+// Move to a block with room for `size` bytes: the next spare one if it is
+// big enough, otherwise a new one linked in after the current block
+static ArenaBlock *next_block(Arena *arena, size_t size)
+{
+    ArenaBlock *current = arena->current;
+    ArenaBlock *spare = current ? current->next : arena->first;
+
+    if (spare && spare->size >= size)
+    {
+        spare->used = 0;
+        arena->current = spare;
+        return spare;
+    }
+
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + block_size);
+    if (!block)
+        arena_out_of_memory();
+    block->used = 0;
+    block->size = block_size;
+    block->next = spare; // a too-small spare is kept for later
+    if (current)
+        current->next = block;
+    else
+        arena->first = block;
+    arena->current = block;
+    return block;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+    ArenaBlock *block = arena->current;
+    if (!block || block->size - block->used < size)
+        block = next_block(arena, size);
+
+    void *memory = (char *)block->data + block->used;
+    block->used += size;
+    return memory;
+}
+
+ArenaMark arena_mark(const Arena *arena)
+{
+    ArenaMark mark;
+    mark.block = arena->current;
+    mark.used = arena->current ? arena->current->used : 0;
+    return mark;
+}
+
+void arena_release(Arena *arena, ArenaMark mark)
+{
+    // A mark taken before the first allocation points at no block: the
+    // first block (if any) is then all spare
+    arena->current = mark.block;
+    if (mark.block)
+        mark.block->used = mark.used;
+}
@@ -0,0 +1,39 @@
+#ifndef ARENA_H
+// "If ARENA_H is not defined yet..."
+#define ARENA_H
+// "...define it now."
+
+#include <stddef.h>
+
+// Bump allocator for objects that die together, such as the nodes of an
+// AST. Allocation is a pointer increment; there is no per-object free.
+// Instead, arena_mark remembers the current top and arena_release drops
+// everything allocated since, in O(1), keeping the blocks for reuse.
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct
+{
+    ArenaBlock *first;
+    ArenaBlock *current; // allocations come from here; later blocks are spare
+} Arena;
+
+// Top of the arena at some point; release to it to free what came after
+typedef struct
+{
+    ArenaBlock *block;
+    size_t used;
+} ArenaMark;
+
+void arena_init(Arena *arena);
+// Free every block; the arena is empty (and usable) again afterwards
+void arena_destroy(Arena *arena);
+
+// Zero-filled is not promised; exits on allocation failure
+void *arena_alloc(Arena *arena, size_t size);
+
+ArenaMark arena_mark(const Arena *arena);
+// Everything allocated after `mark` becomes invalid. Marks nest: releasing
+// to an older mark also releases every younger one.
+void arena_release(Arena *arena, ArenaMark mark);
+
+#endif // ARENA_H
@@ -0,0 +1,301 @@
+#define _POSIX_C_SOURCE 200809L // open_memstream
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+
+// Synthetic lexer input: `gen_corpus <mix> <bytes> [seed]` writes about
+// <bytes> of .tc source to stdout. The same mix, size and seed always give
+// the same file, so benchmark numbers stay comparable between runs.
+//
+// Every mix lexes cleanly; none of them is meant to get past the parser.
+
+typedef void (*Generator)(FILE *out);
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+// xorshift64*: small, fast and the same on every platform
+static uint32_t next_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+// Uniform-ish in [lo, hi]
+static int random_between(int lo, int hi)
+{
+    return lo + (int)(next_random() % (uint32_t)(hi - lo + 1));
+}
+
+static void put_identifier(FILE *out, int length)
+{
+    static const char first[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    static const char rest[] =
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+
+    fputc(first[next_random() % (sizeof(first) - 1)], out);
+    for (int i = 1; i < length; i++)
+        fputc(rest[next_random() % (sizeof(rest) - 1)], out);
+}
+
+// Short names most of the time, as real code has
+static void put_operand_name(FILE *out)
+{
+    put_identifier(out, random_between(1, 8));
+}
+
+static void put_literal(FILE *out)
+{
+    uint32_t value = next_random();
+    switch (next_random() % 4)
+    {
+    case 0:
+        fprintf(out, "%d", (int)(value % 1000000));
+        break;
+    case 1:
+        fprintf(out, "0x%X", value);
+        break;
+    case 2:
+    {
+        // Binary: up to 32 digits, no leading zeros past the prefix
+        int bits = random_between(1, 32);
+        fputs("0b1", out);
+        for (int i = 1; i < bits; i++)
+            fputc('0' + (int)((value >> i) & 1), out);
+        break;
+    }
+    default:
+        fprintf(out, "0%o", value % 0x7FFFFFFF);
+        break;
+    }
+}
+
+static void put_operand(FILE *out)
+{
+    if (next_random() % 3 == 0)
+        put_literal(out);
+    else
+        put_operand_name(out);
+}
+
+// Binary operators that may sit between two operands without a space
+static const char *const binary_ops[] = {
+    "+", "-", "*", "/", "%", "<<", ">>", "<", "<=", ">", ">=", "==", "!=",
+    "&", "^", "|", "&&", "||"};
+
+static const char *const assign_ops[] = {
+    "=", "+=", "-=", "*=", "/=", "%=", "<<=", ">>="};
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+static void put_expression(FILE *out, int terms, const char *gap)
+{
+    put_operand(out);
+    for (int i = 1; i < terms; i++)
+    {
+        fprintf(out, "%s%s%s", gap, binary_ops[next_random() %
+                                                COUNT_OF(binary_ops)],
+                gap);
+        if (next_random() % 8 == 0)
+            fputc('!', out);
+        put_operand(out);
+    }
+}
+
+static void put_statement(FILE *out, int indent)
+{
+    fprintf(out, "%*s", indent * 4, "");
+    if (next_random() % 4 == 0)
+    {
+        fputs("int ", out);
+        put_operand_name(out);
+        fputs(" = ", out);
+    }
+    else
+    {
+        put_operand_name(out);
+        fprintf(out, " %s ",
+                assign_ops[next_random() % COUNT_OF(assign_ops)]);
+    }
+    put_expression(out, random_between(1, 4), " ");
+    fputs(";\n", out);
+}
+
+// Mostly comment text, with a little code between
+static void generate_comments(FILE *out)
+{
+    static const char *const words[] = {
+        "the", "lexer", "skips", "this", "text", "quickly", "because",
+        "comments", "are", "scanned", "in", "bulk", "*", "/", "**", "//"};
+
+    int lines = random_between(1, 6);
+    bool block = next_random() % 2 == 0;
+    fputs(block ? "/*" : "", out);
+    for (int l = 0; l < lines; l++)
+    {
+        fputs(block ? (l == 0 ? " " : "   ") : "// ", out);
+        int count = random_between(4, 14);
+        for (int w = 0; w < count; w++)
+        {
+            const char *word = words[next_random() % COUNT_OF(words)];
+            // Keep "*" and "/" apart so a block comment never closes early
+            if (block && (strcmp(word, "/") == 0 || strcmp(word, "//") == 0))
+                word = "slash";
+            fprintf(out, "%s ", word);
+        }
+        fputc('\n', out);
+    }
+    fputs(block ? "*/\n" : "", out);
+    put_statement(out, 0);
+}
+
+// Declarations and assignments whose names run to dozens of characters
+static void generate_identifiers(FILE *out)
+{
+    fputs("int ", out);
+    put_identifier(out, random_between(16, 64));
+    fputs(" = ", out);
+    put_identifier(out, random_between(16, 64));
+    fputs(" + ", out);
+    put_identifier(out, random_between(16, 64));
+    fputs(";\n", out);
+}
+
+// Long expressions with no blanks between operators and operands
+static void generate_operators(FILE *out)
+{
+    put_operand_name(out);
+    fputs(assign_ops[next_random() % COUNT_OF(assign_ops)], out);
+    put_expression(out, random_between(8, 24), "");
+    fputs(";\n", out);
+    if (next_random() % 4 == 0)
+    {
+        put_operand_name(out);
+        fputs(next_random() % 2 ? "++;\n" : "--;\n", out);
+    }
+}
+
+// Number literals in every base, several per line
+static void generate_literals(FILE *out)
+{
+    fputs("int ", out);
+    put_operand_name(out);
+    fputs(" = ", out);
+    int count = random_between(4, 10);
+    for (int i = 0; i < count; i++)
+    {
+        if (i > 0)
+            fputs(" + ", out);
+        put_literal(out);
+    }
+    fputs(";\n", out);
+}
+
+// Blocks and parentheses nested many levels deep
+static void generate_nesting(FILE *out)
+{
+    static const char *const openers[] = {"if", "while"};
+
+    int depth = random_between(4, 24);
+    for (int d = 0; d < depth; d++)
+    {
+        fprintf(out, "%*s%s (", d * 4, "",
+                openers[next_random() % COUNT_OF(openers)]);
+        int parens = random_between(1, 6);
+        for (int p = 0; p < parens; p++)
+            fputc('(', out);
+        put_expression(out, 2, " ");
+        for (int p = 0; p < parens; p++)
+            fputc(')', out);
+        fputs(")\n", out);
+        fprintf(out, "%*s{\n", d * 4, "");
+        put_statement(out, d + 1);
+    }
+    for (int d = depth - 1; d >= 0; d--)
+        fprintf(out, "%*s}\n", d * 4, "");
+}
+
+static void generate_mixed(FILE *out);
+
+static const struct
+{
+    const char *name;
+    Generator generate;
+} mixes[] = {
+    {"comments", generate_comments},
+    {"identifiers", generate_identifiers},
+    {"operators", generate_operators},
+    {"literals", generate_literals},
+    {"nesting", generate_nesting},
+    {"mixed", generate_mixed},
+};
+
+#define NUM_PURE_MIXES (COUNT_OF(mixes) - 1)
+
+// A bit of everything, the way ordinary code would be
+static void generate_mixed(FILE *out)
+{
+    if (next_random() % 2 == 0)
+        put_statement(out, 0);
+    else
+        mixes[next_random() % NUM_PURE_MIXES].generate(out);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3 || argc > 4)
+    {
+        fprintf(stderr, "Usage: %s <mix> <bytes> [seed]\nMixes:", argv[0]);
+        for (size_t m = 0; m < COUNT_OF(mixes); m++)
+            fprintf(stderr, " %s", mixes[m].name);
+        fputc('\n', stderr);
+        return 1;
+    }
+
+    Generator generate = NULL;
+    for (size_t m = 0; m < COUNT_OF(mixes); m++)
+    {
+        if (strcmp(argv[1], mixes[m].name) == 0)
+            generate = mixes[m].generate;
+    }
+    if (!generate)
+    {
+        fprintf(stderr, "Unknown mix '%s'\n", argv[1]);
+        return 1;
+    }
+
+    long long size = atoll(argv[2]);
+    if (size <= 0)
+    {
+        fprintf(stderr, "Size must be a positive number of bytes\n");
+        return 1;
+    }
+    if (argc == 4)
+        rng_state ^= strtoull(argv[3], NULL, 0) * 0x9E3779B97F4A7C15ULL;
+    if (rng_state == 0)
+        rng_state = 1;
+
+    // Whole fragments only, so the file always ends on a complete line
+    char *corpus = NULL;
+    size_t length = 0;
+    FILE *out = open_memstream(&corpus, &length);
+    if (!out)
+    {
+        perror("open_memstream");
+        return 1;
+    }
+    do
+    {
+        generate(out);
+        fflush(out);
+    } while (length < (size_t)size);
+    fclose(out);
+
+    fwrite(corpus, 1, length, stdout);
+    free(corpus);
+    return ferror(stdout) ? 1 : 0;
+}
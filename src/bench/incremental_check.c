@@ -0,0 +1,198 @@
+#include "../lexer/incremental.h"
+
+// Random check of the incremental lexer: `incremental_check [-n sequences]`
+// opens a TokenBuffer on a small random source, then makes up to
+// EDITS_PER_SEQUENCE random edits to it. After every token_buffer_edit the
+// buffer must hold exactly what lexer_buffer() gives for the new source:
+// type, atom, value, line, column, offset and length of every token.
+//
+// Edits insert and delete comment delimiters, newlines and fragments of
+// tokens, so they open and close comments, split and join tokens, and move
+// lines under the gap. Sources that would not lex cleanly are skipped,
+// since the lexer exits on an error.
+
+#define DEFAULT_SEQUENCES 2000
+#define EDITS_PER_SEQUENCE 200
+#define MAX_SOURCE 4096
+#define FAILURE_FILE "incremental_check_failure.tc"
+
+static uint64_t rng_state;
+
+// xorshift64*, as gen_corpus uses
+static uint32_t next_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+static const char *const snippets[] = {
+    "/*", "*/", "//", "\n", " ", "\t", "a", "bc", "x1", "12", "0x1F", "0b1",
+    "07", "+", "=", "<", "<<=", "-", "--", ";", "{", "}", "(", ")", "/", "*",
+    "int ", "while ", "if", "\n\n", "q = 3;\n", "/* c */", "!", ">", "&&"};
+
+static const char *random_snippet(void)
+{
+    return snippets[next_random() % COUNT_OF(snippets)];
+}
+
+// The same test the parallel lexer's workers use: a speculative lex steps
+// over what would be an error and says so, instead of exiting
+static bool lexes_cleanly(const char *data, size_t length)
+{
+    LexState state;
+    lexer_init(&state, data, length, false);
+    state.speculative = true;
+
+    Token token;
+    while (lexer_next(&state, &token))
+        ;
+    return !state.failed;
+}
+
+static bool same_token(const Token *a, const Token *b)
+{
+    if (a->type != b->type || a->atom != b->atom || a->line != b->line ||
+        a->col != b->col || a->offset != b->offset || a->length != b->length)
+        return false;
+    if (a->type == INT)
+        return a->value.int_val == b->value.int_val;
+    return a->value.str_val == b->value.str_val && a->kind.op == b->kind.op;
+}
+
+// Compare the buffer with a full lex of its source, reporting the first
+// difference
+static bool matches_full_lex(const TokenBuffer *tb)
+{
+    size_t count;
+    Token *tokens = lexer_buffer(tb->data, tb->length, &count);
+    bool same = count == tb_count(tb);
+    if (!same)
+        printf("%zu tokens, a full lex has %zu\n", tb_count(tb), count);
+
+    for (size_t t = 0; same && t < count; t++)
+    {
+        Token token = tb_token(tb, t);
+        same = same_token(&tokens[t], &token);
+        if (!same)
+        {
+            printf("token %zu: line %d col %d offset %u, a full lex has "
+                   "line %d col %d offset %u\n",
+                   t, token.line, token.col, token.offset, tokens[t].line,
+                   tokens[t].col, tokens[t].offset);
+        }
+    }
+    free_tokens(tokens, count);
+    return same;
+}
+
+static void write_failure(const char *before, size_t before_length,
+                          const char *after, size_t after_length)
+{
+    FILE *failure = fopen(FAILURE_FILE, "wb");
+    if (!failure)
+        return;
+    fputs("before the edit:\n", failure);
+    fwrite(before, 1, before_length, failure);
+    fputs("\nafter it:\n", failure);
+    fwrite(after, 1, after_length, failure);
+    fclose(failure);
+    printf("sources written to %s\n", FAILURE_FILE);
+}
+
+int main(int argc, char *argv[])
+{
+    int sequences = DEFAULT_SEQUENCES;
+
+    if (argc == 3 && strcmp(argv[1], "-n") == 0)
+        sequences = atoi(argv[2]);
+    else if (argc != 1)
+    {
+        fprintf(stderr, "Usage: %s [-n sequences]\n", argv[0]);
+        return 1;
+    }
+
+    static char buffers[2][MAX_SOURCE];
+    size_t edits = 0;
+    size_t relexed = 0;
+    size_t kept = 0;
+
+    for (int s = 0; s < sequences; s++)
+    {
+        rng_state = (uint64_t)s * 2654435761ULL + 1;
+        char *source = buffers[0];
+        char *next = buffers[1];
+        size_t length = 0;
+
+        // A lone "/*" would leave the comment open to the end
+        for (int p = next_random() % 60; p > 0; p--)
+        {
+            const char *snippet = random_snippet();
+            if (strcmp(snippet, "/*") == 0)
+                continue;
+            memcpy(source + length, snippet, strlen(snippet));
+            length += strlen(snippet);
+        }
+        if (!lexes_cleanly(source, length))
+            continue;
+
+        TokenBuffer tb;
+        token_buffer_open(&tb, source, length);
+
+        for (int e = 0; e < EDITS_PER_SEQUENCE; e++)
+        {
+            size_t start = next_random() % (length + 1);
+            size_t removed = next_random() % 4 == 0 ? 0 : next_random() % 6;
+            if (removed > length - start)
+                removed = length - start;
+
+            char inserted[64];
+            size_t inserted_length = 0;
+            for (int i = next_random() % 3; i > 0; i--)
+            {
+                const char *snippet = random_snippet();
+                memcpy(inserted + inserted_length, snippet, strlen(snippet));
+                inserted_length += strlen(snippet);
+            }
+
+            size_t next_length = length - removed + inserted_length;
+            if (next_length > MAX_SOURCE)
+                break;
+            memcpy(next, source, start);
+            memcpy(next + start, inserted, inserted_length);
+            memcpy(next + start + inserted_length, source + start + removed,
+                   length - start - removed);
+            if (!lexes_cleanly(next, next_length))
+                continue;
+
+            relexed += token_buffer_edit(&tb, next, next_length, start,
+                                         start + removed,
+                                         start + inserted_length);
+            kept += tb_count(&tb);
+            edits++;
+            if (!matches_full_lex(&tb))
+            {
+                printf("sequence %d, edit %d: [%zu, %zu) replaced by "
+                       "\"%.*s\"\n",
+                       s, e, start, start + removed, (int)inserted_length,
+                       inserted);
+                write_failure(source, length, next, next_length);
+                return 1;
+            }
+
+            char *previous = source;
+            source = next;
+            next = previous;
+            length = next_length;
+        }
+        token_buffer_close(&tb);
+    }
+
+    printf("incremental lexer matches a full lex after %zu edits in %d "
+           "sequences (%zu tokens re-lexed of %zu)\n",
+           edits, sequences, relexed, kept);
+    return 0;
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include <time.h>
+#include "../lexer/lexer.h"
+#include "../lexer/parallel.h"
+
+// Lexer throughput: `lexer_bench [-n runs] [-t threads] file...` lexes each
+// file `runs` times in-process and prints the spread of the timings along
+// with MB/s and tokens/s at the median. Build it with -DLEXER_TRACE=0 (as
+// `make bench-lexer` does), or the trace branches are part of what is
+// measured.
+//
+// With -t, the files go through lexer_buffer_parallel on that many worker
+// threads instead (0: one per online CPU), so running it for 1, 2, 4, ...
+// shows how the chunked lexer scales with cores.
+
+#define DEFAULT_RUNS 20
+#define WARMUP_RUNS 2
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int count, int pct)
+{
+    int rank = (pct * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// threads < 0: lexer_buffer
+static void bench_file(const char *path, int runs, int threads)
+{
+    SourceBuffer source;
+    if (source_open(path, &source) != 0)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    double *times = malloc((size_t)runs * sizeof(double));
+    if (!times)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // lexer() is this plus reading the file, which is not the lexer's cost
+    size_t num_tokens = 0;
+    for (int r = -WARMUP_RUNS; r < runs; r++)
+    {
+        double start = now_seconds();
+        Token *tokens = threads < 0 ? lexer_buffer(source.data, source.length,
+                                                   &num_tokens)
+                                    : lexer_buffer_parallel(source.data,
+                                                            source.length,
+                                                            threads,
+                                                            &num_tokens);
+        double elapsed = now_seconds() - start;
+        free_tokens(tokens, num_tokens);
+        if (r >= 0)
+            times[r] = elapsed;
+    }
+
+    qsort(times, (size_t)runs, sizeof(double), compare_doubles);
+    double median = percentile(times, runs, 50);
+    double megabytes = (double)source.length / 1e6;
+
+    const char *name = strrchr(path, '/');
+    printf("%-16s %8.2f %10zu %8.2f %8.2f %8.2f %8.2f %8.1f %8.2f\n",
+           name ? name + 1 : path, megabytes, num_tokens,
+           times[0] * 1e3, median * 1e3, percentile(times, runs, 90) * 1e3,
+           percentile(times, runs, 99) * 1e3, megabytes / median,
+           (double)num_tokens / median / 1e6);
+
+    free(times);
+    source_close(&source);
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = DEFAULT_RUNS;
+    int threads = -1;
+    int first = 1;
+
+    while (first + 1 < argc && argv[first][0] == '-')
+    {
+        if (strcmp(argv[first], "-n") == 0)
+            runs = atoi(argv[first + 1]);
+        else if (strcmp(argv[first], "-t") == 0)
+            threads = atoi(argv[first + 1]);
+        else
+            break;
+        first += 2;
+    }
+    if (first >= argc || runs < 1)
+    {
+        fprintf(stderr, "Usage: %s [-n runs] [-t threads] <source_file>...\n",
+                argv[0]);
+        return 1;
+    }
+    if (threads == 0)
+        threads = lexer_thread_count();
+    if (threads >= 0)
+        printf("lexer_buffer_parallel, %d threads\n", threads);
+
+    printf("%-16s %8s %10s %8s %8s %8s %8s %8s %8s\n", "input", "MB",
+           "tokens", "min ms", "p50 ms", "p90 ms", "p99 ms", "MB/s",
+           "Mtok/s");
+    for (int i = first; i < argc; i++)
+        bench_file(argv[i], runs, threads);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime, dup
+#include <time.h>
+#include <unistd.h>
+#include "../lexer/stream.h"
+#include "../vm/vm.h"     // LOOP_VM; includes the parser
+#include "../vm/affine.h" // LOOP_AFFINE and LOOP_INDUCTION
+
+// Loop evaluation: `loop_bench [-n runs] file...` lexes and parses each
+// file `runs` times in-process and prints the spread of the timings. The
+// parser runs every loop to completion, so on loop-heavy inputs that is
+// most of the time. `make bench-loops` builds it three times: as the
+// compiler is, with the closed forms off (LOOP_INDUCTION=0, LOOP_AFFINE=0)
+// to time the loop VM alone, and with the VM off too, so that every
+// iteration runs on the syntax tree. Each table says which it is.
+
+#define DEFAULT_RUNS 10
+#define WARMUP_RUNS 1
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int count, int pct)
+{
+    int rank = (pct * count + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+static void bench_file(FILE *results, const char *path, int runs)
+{
+    SourceBuffer source;
+    if (source_open(path, &source) != 0)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    double *times = malloc((size_t)runs * sizeof(double));
+    if (!times)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int r = -WARMUP_RUNS; r < runs; r++)
+    {
+        double start = now_seconds();
+        TokenStream stream;
+        token_stream_open(&stream, source.data, source.length, false);
+        Node *root = parse(&stream);
+        free_ast(root);
+        double elapsed = now_seconds() - start;
+        if (r >= 0)
+            times[r] = elapsed;
+    }
+
+    qsort(times, (size_t)runs, sizeof(double), compare_doubles);
+    const char *name = strrchr(path, '/');
+    fprintf(results, "%-16s %10.2f %10.2f %10.2f\n", name ? name + 1 : path,
+            times[0] * 1e3, percentile(times, runs, 50) * 1e3,
+            percentile(times, runs, 90) * 1e3);
+
+    free(times);
+    source_close(&source);
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = DEFAULT_RUNS;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0)
+    {
+        runs = atoi(argv[2]);
+        first = 3;
+    }
+    if (first >= argc || runs < 1)
+    {
+        fprintf(stderr, "Usage: %s [-n runs] <source_file>...\n", argv[0]);
+        return 1;
+    }
+
+    // The parser's progress output goes to stdout; keep it out of the table
+    FILE *results = fdopen(dup(STDOUT_FILENO), "w");
+    if (!results || !freopen("/dev/null", "w", stdout))
+    {
+        perror("stdout");
+        return 1;
+    }
+
+    fprintf(results, "loops on the %s%s\n",
+            LOOP_VM ? "bytecode VM" : "syntax tree",
+            LOOP_INDUCTION && LOOP_AFFINE
+                ? ", induction and affine loops in closed form"
+            : LOOP_INDUCTION ? ", induction loops in closed form"
+            : LOOP_AFFINE    ? ", affine loops in closed form"
+                             : ", no closed forms");
+    fprintf(results, "%-16s %10s %10s %10s\n", "input", "min ms", "p50 ms",
+            "p90 ms");
+    for (int i = first; i < argc; i++)
+        bench_file(results, argv[i], runs);
+    fclose(results);
+    return 0;
+}
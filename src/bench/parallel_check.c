@@ -0,0 +1,258 @@
+#define _POSIX_C_SOURCE 200809L // open_memstream, fileno
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../lexer/parallel.h"
+
+// Differential check of the parallel lexer: `parallel_check [-n cases]
+// [file...]` lexes each file, then `cases` random sources, with
+// lexer_buffer() and with lexer_buffer_parallel() on 1 to MAX_THREADS
+// workers. Every token and the way the lex ended (exit status and error
+// message) must match. Build it with -DPARALLEL_MIN_CHUNK=1 (as `make
+// check-parallel` does), or sources this small are never cut into chunks.
+//
+// The random sources are mostly code with /* */ comments over many lines,
+// so cuts land inside comments, and now and then a stray character or bad
+// literal outside one, so genuine errors have to be reported too.
+
+#define DEFAULT_CASES 500
+#define MAX_THREADS 12
+#define FAILURE_FILE "parallel_check_failure.tc"
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+// xorshift64*, as gen_corpus uses
+static uint32_t next_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static int random_between(int lo, int hi)
+{
+    return lo + (int)(next_random() % (uint32_t)(hi - lo + 1));
+}
+
+#define COUNT_OF(array) (sizeof(array) / sizeof((array)[0]))
+
+// Pieces that lex cleanly on their own
+static const char *const code[] = {
+    "int a = 0x1F;", "b += 0b101;", "while (a < 10) {", "}", "x = y << 2;",
+    "// c /* not open", " ", "\t", "c=3;", "/* one line */", "a/**/b",
+    "zzLongIdentifierNameHere = 12345678;", "", ";;",
+    "if (x) { y = 1; } else { y = 2; }"};
+
+// Pieces that are only safe inside a comment
+static const char *const garbage[] = {
+    "@ # $", "0x", "\"str\"", "0b2", "*", "/", "/ *", "int q = 4;", "//",
+    "/*", "99999999999", "\\", "a /", "```"};
+
+// What may follow a comment's "*/": a stray "*/" is two operators
+static const char *const after_comment[] = {"", " x = 1;", "*/", " /",
+                                            "/ 2;"};
+
+static void put_words(FILE *out, const char *const *words, size_t count,
+                      int max_words)
+{
+    int n = random_between(0, max_words);
+    for (int w = 0; w < n; w++)
+        fprintf(out, "%s%s", w > 0 ? " " : "", words[next_random() % count]);
+}
+
+// A /* */ comment over several lines, holding anything but its end
+static void put_comment(FILE *out)
+{
+    fprintf(out, "%s /*", code[next_random() % COUNT_OF(code)]);
+    int lines = random_between(0, 12);
+    for (int l = 0; l < lines; l++)
+    {
+        if (l > 0)
+            fputc('\n', out);
+        for (int w = random_between(0, 5); w > 0; w--)
+        {
+            const char *word = next_random() % 2
+                                   ? garbage[next_random() %
+                                             COUNT_OF(garbage)]
+                                   : code[next_random() % COUNT_OF(code)];
+            // "/* one line */" would close the comment early
+            fprintf(out, "%s ", strstr(word, "*/") ? "* /" : word);
+        }
+    }
+    fprintf(out, "*/%s",
+            after_comment[next_random() % COUNT_OF(after_comment)]);
+}
+
+static char *generate_source(size_t *length_out)
+{
+    char *data = NULL;
+    FILE *out = open_memstream(&data, length_out);
+    if (!out)
+    {
+        perror("open_memstream");
+        exit(EXIT_FAILURE);
+    }
+
+    int lines = random_between(5, 300);
+    for (int l = 0; l < lines; l++)
+    {
+        if (l > 0)
+            fputc('\n', out);
+        uint32_t pick = next_random() % 100;
+        if (pick < 15)
+            put_comment(out);
+        else if (pick < 17)
+            put_words(out, garbage, COUNT_OF(garbage), 2);
+        else
+            put_words(out, code, COUNT_OF(code), 5);
+    }
+    if (next_random() % 2)
+        fputc('\n', out);
+    fclose(out);
+    return data;
+}
+
+// Lex in a child process, since the lexer exits on an error, and leave
+// the tokens and the way it ended in `out`. threads == 0: lexer_buffer.
+static void lex_to_file(const char *data, size_t length, int threads,
+                        FILE *out)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        perror("fork");
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0)
+    {
+        dup2(fileno(out), STDOUT_FILENO);
+        dup2(fileno(out), STDERR_FILENO);
+
+        size_t count;
+        Token *tokens = threads == 0
+                            ? lexer_buffer(data, length, &count)
+                            : lexer_buffer_parallel(data, length, threads,
+                                                    &count);
+        for (size_t t = 0; t < count; t++)
+        {
+            const Token *token = &tokens[t];
+            printf("%d %u %d:%d @%u+%u %d ", (int)token->type, token->atom,
+                   token->line, token->col, token->offset, token->length,
+                   (int)token->kind.op);
+            if (token->type == INT)
+                printf("%d\n", token->value.int_val);
+            else
+                printf("%s\n", token->value.str_val);
+        }
+        fflush(stdout);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    fseek(out, 0, SEEK_END);
+    fprintf(out, "status %d\n", status);
+    rewind(out);
+}
+
+static bool same_contents(FILE *a, FILE *b)
+{
+    int ca, cb;
+    do
+    {
+        ca = fgetc(a);
+        cb = fgetc(b);
+    } while (ca == cb && ca != EOF);
+    return ca == cb;
+}
+
+// Check one source on every thread count; false, with a report, on the
+// first difference
+static bool check_source(const char *name, const char *data, size_t length)
+{
+    FILE *expected = tmpfile();
+    if (!expected)
+    {
+        perror("tmpfile");
+        exit(EXIT_FAILURE);
+    }
+    lex_to_file(data, length, 0, expected);
+
+    bool same = true;
+    for (int threads = 1; same && threads <= MAX_THREADS; threads++)
+    {
+        FILE *actual = tmpfile();
+        if (!actual)
+        {
+            perror("tmpfile");
+            exit(EXIT_FAILURE);
+        }
+        lex_to_file(data, length, threads, actual);
+        rewind(expected);
+        same = same_contents(expected, actual);
+        fclose(actual);
+        if (!same)
+            printf("%s: differs from lexer_buffer with %d threads\n", name,
+                   threads);
+    }
+    fclose(expected);
+    return same;
+}
+
+int main(int argc, char *argv[])
+{
+    int cases = DEFAULT_CASES;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "-n") == 0)
+    {
+        cases = atoi(argv[2]);
+        first = 3;
+    }
+    if (cases < 0)
+    {
+        fprintf(stderr, "Usage: %s [-n cases] [source_file]...\n", argv[0]);
+        return 1;
+    }
+
+    for (int i = first; i < argc; i++)
+    {
+        SourceBuffer source;
+        if (source_open(argv[i], &source) != 0)
+        {
+            perror(argv[i]);
+            return 1;
+        }
+        bool same = check_source(argv[i], source.data, source.length);
+        source_close(&source);
+        if (!same)
+            return 1;
+    }
+
+    for (int c = 0; c < cases; c++)
+    {
+        size_t length;
+        char *data = generate_source(&length);
+        char name[32];
+        snprintf(name, sizeof(name), "random case %d", c);
+        if (!check_source(name, data, length))
+        {
+            FILE *failure = fopen(FAILURE_FILE, "wb");
+            if (failure)
+            {
+                fwrite(data, 1, length, failure);
+                fclose(failure);
+                printf("source written to %s\n", FAILURE_FILE);
+            }
+            return 1;
+        }
+        free(data);
+    }
+
+    printf("parallel lexer matches lexer_buffer on %d files and %d random "
+           "sources, 1 to %d threads\n",
+           argc - first, cases, MAX_THREADS);
+    return 0;
+}
@@ -1,143 +1,155 @@
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include "codegen.h"
 
-void traverse_tree(Node *node, FILE *file, ScopeType scope, bool *exit_emitted,
-                   bool active_block)
+// A subtree still to visit, and whether the code around it runs
+typedef struct
 {
-    if (node == NULL || *exit_emitted)
-        return;
+    NodeIndex index;
+    bool active_block;
+} PendingVisit;
 
-    switch (node->type)
-    {
-    case NODE_EXIT_CALL:
-        if (!*exit_emitted && active_block)
-        {
-            fprintf(file, "\tmov rax, 60\n");
-            if (node->left)
-                fprintf(file, "\tmov rdi, %d\n", node->left->value.int_val);
-            else
-                fprintf(file, "\tmov rdi, 0\n");
-            fprintf(file, "\tsyscall\n");
-            *exit_emitted = true;
-        }
-        return;
+typedef struct
+{
+    PendingVisit *items;
+    size_t count;
+    size_t capacity;
+} VisitStack;
 
-    case NODE_IF_STATEMENT:
+static void push_visit(VisitStack *stack, NodeIndex index, bool active_block)
+{
+    if (index == AST_NONE)
+        return;
+    if (stack->count >= stack->capacity)
     {
-        Node *cond = node->left;
-        Node *then_block = cond ? cond->right : NULL;
-        bool condition_active = false;
+        stack->capacity = stack->capacity ? stack->capacity * 2 : 64;
+        stack->items = realloc(stack->items,
+                               stack->capacity * sizeof(PendingVisit));
+        assert(stack->items && "Failed to grow traversal stack");
+    }
+    stack->items[stack->count++] = (PendingVisit){index, active_block};
+}
 
-        // Evaluate condition if possible
-        if (cond && cond->type == NODE_LITERAL_INT)
-        {
-            condition_active = (cond->value.int_val != 0);
-        }
+// The block an if statement runs: its own when the condition holds,
+// otherwise the first else-if whose condition may hold, or the else
+static NodeIndex taken_branch(const Ast *ast, const AstNode *node)
+{
+    const AstNode *cond = node->left ? ast_node(ast, node->left) : NULL;
+    NodeIndex then_block = cond ? cond->right : AST_NONE;
+
+    // Evaluate condition if possible
+    if (cond && cond->type == NODE_LITERAL_INT && cond->value.int_val != 0)
+        return then_block;
 
-        // Process then block if condition is true and we're in an active block
-        if (then_block && active_block && condition_active)
+    for (NodeIndex else_index = node->right; else_index != AST_NONE;
+         else_index = ast_node(ast, else_index)->right)
+    {
+        const AstNode *else_node = ast_node(ast, else_index);
+        switch (else_node->type)
+        {
+        case NODE_ELSE_IF_STATEMENT:
         {
-            traverse_tree(then_block, file, scope, exit_emitted, true);
+            const AstNode *else_if_cond =
+                else_node->left ? ast_node(ast, else_node->left) : NULL;
+            NodeIndex else_if_block =
+                else_if_cond ? else_if_cond->right : AST_NONE;
+
+            // For non-constant conditions, assume true
+            bool else_if_active =
+                else_if_cond && (else_if_cond->type != NODE_LITERAL_INT ||
+                                 else_if_cond->value.int_val != 0);
+            if (else_if_block && else_if_active)
+                return else_if_block; // Found active else-if, skip rest
+            break;
         }
 
-        // Only process else/else if if the if condition was false and
-        // we're active
-        if (active_block && !condition_active)
-        {
-            Node *else_node = node->right;
-            bool found_active_else = false;
+        case NODE_ELSE_STATEMENT:
+            // Else block is always active if we get here
+            return else_node->left;
 
-            while (else_node && !found_active_else && !*exit_emitted)
-            {
-                switch (else_node->type)
-                {
-                case NODE_ELSE_IF_STATEMENT:
-                {
-                    Node *else_if_cond = else_node->left;
-                    Node *else_if_block =
-                        else_if_cond ? else_if_cond->right : NULL;
-                    bool else_if_active = false;
-
-                    if (else_if_cond && else_if_cond->type == NODE_LITERAL_INT)
-                    {
-                        else_if_active = (else_if_cond->value.int_val != 0);
-                    }
-                    else if (else_if_cond)
-                    {
-                        // For non-constant conditions, assume true
-                        else_if_active = true;
-                    }
-
-                    if (else_if_block && else_if_active)
-                    {
-                        traverse_tree(else_if_block, file, scope,
-                                      exit_emitted, true);
-                        // Found active else-if, skip rest
-                        found_active_else = true;
-                    }
-                    break;
-                }
-
-                case NODE_ELSE_STATEMENT:
-                    // Else block is always active if we get here
-                    traverse_tree(else_node->left, file, scope, 
-                        exit_emitted, true);
-                        // Found else, skip any remaining else-ifs
-                    found_active_else = true; 
-                    break;
-
-                default:
-                    break;
-                }
-
-                else_node = else_node->right;
-            }
+        default:
+            break;
         }
-
-        // Continue with siblings
-        traverse_tree(node->right, file, scope, exit_emitted, active_block);
-        return;
     }
+    return AST_NONE;
+}
+
+// Emits code for `index` and its siblings, in tree order. Pending subtrees
+// go on an explicit stack, so a block of any length, or code nested to any
+// depth, costs no C stack.
+void traverse_tree(const Ast *ast, NodeIndex index, FILE *file,
+                   ScopeType scope, bool *exit_emitted, bool active_block)
+{
+    (void)scope; // no construct depends on it yet
+    VisitStack stack = {NULL, 0, 0};
+    push_visit(&stack, index, active_block);
 
-    case NODE_WHILE_STATEMENT:
+    // Visit order is the recursive one: a node's children before its
+    // siblings, so each sibling is pushed before the children
+    while (stack.count > 0 && !*exit_emitted)
     {
-        Node *cond = node->left;
-        Node *loop_block = cond ? cond->right : NULL;
-        bool condition_active = false;
+        PendingVisit visit = stack.items[--stack.count];
+        const AstNode *node = ast_node(ast, visit.index);
+        active_block = visit.active_block;
 
-        if (cond && cond->type == NODE_LITERAL_INT)
+        switch (node->type)
         {
-            condition_active = cond->value.int_val != 0;
-        }
-        // else if (cond && cond->type == NODE_IDENTIFIER)
-        // {
-        //     // or look up variable value if you track it
-        //     condition_active = true; 
-        // }
-        else if (cond)
+        case NODE_EXIT_CALL:
+            if (active_block)
+            {
+                fprintf(file, "\tmov rax, 60\n");
+                if (node->left)
+                    fprintf(file, "\tmov rdi, %d\n",
+                            ast_node(ast, node->left)->value.int_val);
+                else
+                    fprintf(file, "\tmov rdi, 0\n");
+                fprintf(file, "\tsyscall\n");
+                *exit_emitted = true;
+            }
+            // Nothing after an exit is visited
+            break;
+
+        case NODE_IF_STATEMENT:
         {
-            condition_active = true; // assume true for non-literals
+            // Continue with siblings (the else chain among them)
+            push_visit(&stack, node->right, active_block);
+
+            // Process then block if condition is true and we're in an
+            // active block; else/else if only when it was false
+            if (active_block)
+                push_visit(&stack, taken_branch(ast, node), true);
+            break;
         }
 
-        if (loop_block && active_block && condition_active)
+        case NODE_WHILE_STATEMENT:
         {
-            traverse_tree(loop_block, file, scope, exit_emitted, true);
+            const AstNode *cond =
+                node->left ? ast_node(ast, node->left) : NULL;
+            NodeIndex loop_block = cond ? cond->right : AST_NONE;
+
+            // Assume true for non-literals
+            bool condition_active =
+                cond && (cond->type != NODE_LITERAL_INT ||
+                         cond->value.int_val != 0);
+
+            push_visit(&stack, node->right, active_block);
+            if (active_block && condition_active)
+                push_visit(&stack, loop_block, true);
+            break;
         }
 
-        traverse_tree(node->right, file, scope, exit_emitted, active_block);
-        return;
-    }
-
-    default:
-        break;
+        default:
+            push_visit(&stack, node->right, active_block);
+            push_visit(&stack, node->left, active_block);
+            break;
+        }
     }
 
-    traverse_tree(node->left, file, scope, exit_emitted, active_block);
-    traverse_tree(node->right, file, scope, exit_emitted, active_block);
+    free(stack.items);
 }
 
-int generate_code(Node *root, const char *filename)
+int generate_code(const Ast *ast, const char *filename)
 {
     FILE *file = fopen(filename, "w");
     assert(file && "Failed to open output file");
@@ -147,7 +159,7 @@ int generate_code(Node *root, const char *filename)
     fprintf(file, "_start:\n");
 
     bool exit_emitted = false;
-    traverse_tree(root, file, SCOPE_GLOBAL, &exit_emitted, true);
+    traverse_tree(ast, ast->root, file, SCOPE_GLOBAL, &exit_emitted, true);
 
     if (!exit_emitted)
     {
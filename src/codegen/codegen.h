@@ -4,7 +4,7 @@
 // "...define it now."
 
 #include <stdio.h>
-#include "../parser/parser.h"
+#include "../parser/ast.h"
 
 typedef enum {
     SCOPE_GLOBAL,
@@ -12,6 +12,6 @@ typedef enum {
 } ScopeType;
 
 // int generate_code(Node *root, char *filename);
-int generate_code(Node *root, const char *filename);
+int generate_code(const Ast *ast, const char *filename);
 
 #endif // CODEGEN_H
\ No newline at end of file
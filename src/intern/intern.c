@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+
+#define INTERN_BLOCK_SIZE 65536
+#define INITIAL_SLOT_CAPACITY 256
+#define INITIAL_ENTRY_CAPACITY 128
+
+// String bytes live in large blocks so canonical pointers never move and
+// millions of names cost a handful of allocations
+typedef struct InternBlock
+{
+    struct InternBlock *next;
+    size_t used;
+    size_t size;
+    char data[];
+} InternBlock;
+
+typedef struct
+{
+    const char *str;
+    uint32_t length;
+    uint32_t hash;
+} InternEntry;
+
+// One string table. The global interner is one of these; lexer worker
+// threads get private ones (see interner_create).
+struct Interner
+{
+    InternBlock *blocks;
+    InternEntry *entries; // indexed by atom, entries[0] unused
+    size_t entry_count;
+    size_t entry_capacity;
+    Atom *slots; // open addressing, ATOM_NONE marks an empty slot
+    size_t slot_capacity;
+};
+
+// should be local to the interner only hence static
+static Interner global_interner = {NULL, NULL, 1, 0, NULL, 0};
+
+static void intern_out_of_memory(void)
+{
+    fprintf(stderr, "Memory allocation failed in string interner\n");
+    exit(EXIT_FAILURE);
+}
+
+// FNV-1a
+static uint32_t hash_bytes(const char *str, size_t length)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static const char *store_bytes(Interner *in, const char *str, size_t length)
+{
+    if (!in->blocks || in->blocks->size - in->blocks->used < length + 1)
+    {
+        size_t size = length + 1 > INTERN_BLOCK_SIZE ? length + 1
+                                                     : INTERN_BLOCK_SIZE;
+        InternBlock *block = malloc(sizeof(InternBlock) + size);
+        if (!block)
+            intern_out_of_memory();
+        block->next = in->blocks;
+        block->used = 0;
+        block->size = size;
+        in->blocks = block;
+    }
+
+    char *copy = in->blocks->data + in->blocks->used;
+    memcpy(copy, str, length);
+    copy[length] = '\0';
+    in->blocks->used += length + 1;
+    return copy;
+}
+
+static void grow_slots(Interner *in)
+{
+    size_t new_capacity = in->slot_capacity ? in->slot_capacity * 2
+                                            : INITIAL_SLOT_CAPACITY;
+    Atom *new_slots = calloc(new_capacity, sizeof(Atom));
+    if (!new_slots)
+        intern_out_of_memory();
+
+    size_t mask = new_capacity - 1;
+    for (Atom atom = 1; atom < in->entry_count; atom++)
+    {
+        size_t slot = in->entries[atom].hash & mask;
+        while (new_slots[slot] != ATOM_NONE)
+            slot = (slot + 1) & mask;
+        new_slots[slot] = atom;
+    }
+
+    free(in->slots);
+    in->slots = new_slots;
+    in->slot_capacity = new_capacity;
+}
+
+Atom interner_intern_n(Interner *in, const char *str, size_t length)
+{
+    if (!str)
+        return ATOM_NONE;
+
+    // Keep the load factor at or below one half
+    if ((in->entry_count + 1) * 2 > in->slot_capacity)
+        grow_slots(in);
+
+    uint32_t hash = hash_bytes(str, length);
+    size_t mask = in->slot_capacity - 1;
+    size_t slot = hash & mask;
+
+    while (in->slots[slot] != ATOM_NONE)
+    {
+        InternEntry *entry = &in->entries[in->slots[slot]];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->str, str, length) == 0)
+        {
+            return in->slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    if (in->entry_count >= in->entry_capacity)
+    {
+        size_t new_capacity = in->entry_capacity ? in->entry_capacity * 2
+                                                 : INITIAL_ENTRY_CAPACITY;
+        InternEntry *new_entries =
+            realloc(in->entries, new_capacity * sizeof(InternEntry));
+        if (!new_entries)
+            intern_out_of_memory();
+        in->entries = new_entries;
+        in->entry_capacity = new_capacity;
+    }
+
+    Atom atom = (Atom)in->entry_count++;
+    in->entries[atom].str = store_bytes(in, str, length);
+    in->entries[atom].length = (uint32_t)length;
+    in->entries[atom].hash = hash;
+    in->slots[slot] = atom;
+    return atom;
+}
+
+const char *interner_str(const Interner *in, Atom atom)
+{
+    if (atom == ATOM_NONE || atom >= in->entry_count)
+        return NULL;
+    return in->entries[atom].str;
+}
+
+size_t interner_len(const Interner *in, Atom atom)
+{
+    if (atom == ATOM_NONE || atom >= in->entry_count)
+        return 0;
+    return in->entries[atom].length;
+}
+
+size_t interner_count(const Interner *in)
+{
+    return in->entry_count - 1;
+}
+
+static void interner_release(Interner *in)
+{
+    while (in->blocks)
+    {
+        InternBlock *next = in->blocks->next;
+        free(in->blocks);
+        in->blocks = next;
+    }
+    free(in->entries);
+    free(in->slots);
+    in->entries = NULL;
+    in->slots = NULL;
+    in->entry_count = 1;
+    in->entry_capacity = 0;
+    in->slot_capacity = 0;
+}
+
+Interner *interner_create(void)
+{
+    Interner *in = malloc(sizeof(Interner));
+    if (!in)
+        intern_out_of_memory();
+    in->blocks = NULL;
+    in->entries = NULL;
+    in->entry_count = 1;
+    in->entry_capacity = 0;
+    in->slots = NULL;
+    in->slot_capacity = 0;
+    return in;
+}
+
+void interner_destroy(Interner *in)
+{
+    if (!in)
+        return;
+    interner_release(in);
+    free(in);
+}
+
+Atom intern_n(const char *str, size_t length)
+{
+    return interner_intern_n(&global_interner, str, length);
+}
+
+Atom intern(const char *str)
+{
+    return str ? intern_n(str, strlen(str)) : ATOM_NONE;
+}
+
+const char *atom_str(Atom atom)
+{
+    return interner_str(&global_interner, atom);
+}
+
+size_t atom_len(Atom atom)
+{
+    return interner_len(&global_interner, atom);
+}
+
+size_t intern_count(void)
+{
+    return interner_count(&global_interner);
+}
+
+void intern_free_all(void)
+{
+    interner_release(&global_interner);
+}
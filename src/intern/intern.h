@@ -0,0 +1,40 @@
+#ifndef INTERN_H
+// "If INTERN_H is not defined yet..."
+#define INTERN_H
+// "...define it now."
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Stable ID for an interned string. Equal strings always get the same atom
+// (and the same canonical pointer), so name equality is an integer compare.
+typedef uint32_t Atom;
+
+#define ATOM_NONE ((Atom)0)
+
+Atom intern(const char *str);
+Atom intern_n(const char *str, size_t length);
+
+// Canonical NUL-terminated copy; NULL for ATOM_NONE. The pointer stays valid
+// until intern_free_all().
+const char *atom_str(Atom atom);
+size_t atom_len(Atom atom);
+
+// Number of distinct strings interned so far
+size_t intern_count(void);
+
+// Release every interned string; all atoms and pointers become invalid
+void intern_free_all(void);
+
+// A separate string table, e.g. for a lexer worker thread. Its atoms mean
+// nothing to the global interner; the functions above never touch it.
+typedef struct Interner Interner;
+
+Interner *interner_create(void);
+void interner_destroy(Interner *interner);
+Atom interner_intern_n(Interner *interner, const char *str, size_t length);
+const char *interner_str(const Interner *interner, Atom atom);
+size_t interner_len(const Interner *interner, Atom atom);
+size_t interner_count(const Interner *interner);
+
+#endif // INTERN_H
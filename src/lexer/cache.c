@@ -0,0 +1,402 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cache.h"
+#include "parallel.h"
+
+#define TOKEN_CACHE_MAGIC "TOYCCTOK"
+// Bump whenever the layout below changes
+#define TOKEN_CACHE_FORMAT 1
+#define INITIAL_CACHE_TOKENS 1024
+#define CACHE_PATH_MAX 4096
+
+// Sources at least this big are lexed by lexer_buffer_parallel on a miss
+#ifndef CACHE_PARALLEL_MIN
+#define CACHE_PARALLEL_MIN (4 * 1024 * 1024)
+#endif
+
+// File layout: this header, the atom texts (string_bytes), then
+// payloads[num_tokens], offsets[num_tokens], line_starts[num_lines] and
+// codes[num_tokens]. Every array starts 4-byte aligned.
+typedef struct
+{
+    char magic[8];
+    uint32_t format;
+    uint32_t num_tokens;
+    uint64_t fingerprint; // lexer_fingerprint() of the writer
+    uint64_t source_hash;
+    uint64_t source_length;
+    uint64_t body_hash; // of everything after the header
+    uint32_t num_atoms;
+    uint32_t num_lines;
+    uint32_t string_bytes; // NUL-terminated, padded to a multiple of 4
+    uint32_t reserved;
+} TokenCacheHeader;
+
+// Only has to tell edited sources (or damaged cache files) apart, and be
+// fast: one multiply per word
+static uint64_t hash_bytes(const char *data, size_t length)
+{
+    uint64_t hash = 0x9E3779B97F4A7C15ULL ^ length;
+    size_t i = 0;
+
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0xFF51AFD7ED558CCDULL;
+        hash ^= hash >> 32;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, length - i);
+    hash = (hash ^ tail) * 0xC4CEB9FE1A85EC53ULL;
+    return hash ^ (hash >> 29);
+}
+
+// Check a mapped cache file against the source and adopt its arrays. Atom
+// texts are interned in order; in a fresh process they get back the IDs
+// they had when written, so the payloads can be used in place.
+static bool load_cache(TokenCache *cache, const char *path, uint64_t hash,
+                       size_t length)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TokenCacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+        return false;
+
+    const TokenCacheHeader *header = mapping;
+    size_t n = header->num_tokens;
+    if (memcmp(header->magic, TOKEN_CACHE_MAGIC, 8) != 0 ||
+        header->format != TOKEN_CACHE_FORMAT ||
+        header->fingerprint != lexer_fingerprint() ||
+        header->source_hash != hash || header->source_length != length ||
+        header->num_lines == 0 || header->string_bytes % 4 != 0 ||
+        size != sizeof(TokenCacheHeader) + header->string_bytes +
+                    4 * (2 * n + header->num_lines) + n ||
+        header->body_hash != hash_bytes((const char *)(header + 1),
+                                        size - sizeof(TokenCacheHeader)))
+    {
+        munmap(mapping, size);
+        return false;
+    }
+
+    const char *strings = (const char *)(header + 1);
+    const uint32_t *payloads =
+        (const uint32_t *)(strings + header->string_bytes);
+    const uint32_t *offsets = payloads + n;
+    const uint32_t *line_starts = offsets + n;
+    const TokenCode *codes = (const TokenCode *)(line_starts +
+                                                 header->num_lines);
+
+    // Even a file that hashes right must not lead the parser astray
+    bool valid = line_starts[0] == 0;
+    for (size_t l = 1; valid && l < header->num_lines; l++)
+        valid = line_starts[l] > line_starts[l - 1] &&
+                line_starts[l] <= length;
+    for (size_t t = 0; valid && t < n; t++)
+    {
+        valid = codes[t] != TC_EOF && codes[t] < TC_COUNT &&
+                offsets[t] < length &&
+                (t == 0 || offsets[t] > offsets[t - 1]) &&
+                (codes[t] == TC_INT ||
+                 (payloads[t] != ATOM_NONE &&
+                  payloads[t] <= header->num_atoms));
+    }
+
+    Atom *remap = NULL;
+    const char *text = strings;
+    const char *strings_end = strings + header->string_bytes;
+    for (Atom atom = 1; valid && atom <= header->num_atoms; atom++)
+    {
+        const char *nul = memchr(text, '\0', (size_t)(strings_end - text));
+        if (!nul)
+        {
+            valid = false;
+            break;
+        }
+
+        Atom global = intern_n(text, (size_t)(nul - text));
+        if (global != atom && !remap)
+        {
+            remap = malloc((header->num_atoms + 1) * sizeof(Atom));
+            if (!remap)
+            {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            for (Atom same = 0; same < atom; same++)
+                remap[same] = same;
+        }
+        if (remap)
+            remap[atom] = global;
+        text = nul + 1;
+    }
+
+    if (!valid)
+    {
+        free(remap);
+        munmap(mapping, size);
+        return false;
+    }
+
+    if (remap)
+    {
+        // The interner had other strings first: renumber a private copy
+        cache->own_payloads = malloc((n > 0 ? n : 1) * sizeof(uint32_t));
+        if (!cache->own_payloads)
+        {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t t = 0; t < n; t++)
+        {
+            cache->own_payloads[t] = codes[t] == TC_INT ? payloads[t]
+                                                        : remap[payloads[t]];
+        }
+        payloads = cache->own_payloads;
+        free(remap);
+    }
+
+    cache->mapping = mapping;
+    cache->mapping_size = size;
+    cache->num_tokens = n;
+    cache->codes = codes;
+    cache->payloads = payloads;
+    cache->offsets = offsets;
+    cache->line_starts = line_starts;
+    cache->num_lines = header->num_lines;
+    return true;
+}
+
+static void grow_arrays(TokenCache *cache, size_t capacity)
+{
+    TokenCode *codes = realloc(cache->own_codes, capacity * sizeof(TokenCode));
+    if (codes)
+        cache->own_codes = codes;
+    uint32_t *payloads = realloc(cache->own_payloads,
+                                 capacity * sizeof(uint32_t));
+    if (payloads)
+        cache->own_payloads = payloads;
+    uint32_t *offsets = realloc(cache->own_offsets,
+                                capacity * sizeof(uint32_t));
+    if (offsets)
+        cache->own_offsets = offsets;
+    if (!codes || !payloads || !offsets)
+    {
+        fprintf(stderr, "Reallocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Lex a large source on every CPU, then index its lines in one scan
+static void lex_all_parallel(TokenCache *cache, const char *data,
+                             size_t length)
+{
+    size_t count;
+    Token *tokens = lexer_buffer_parallel(data, length, 0, &count);
+
+    grow_arrays(cache, count > 0 ? count : 1);
+    for (size_t i = 0; i < count; i++)
+    {
+        cache->own_codes[i] = token_code(&tokens[i]);
+        cache->own_payloads[i] = token_payload(&tokens[i]);
+        cache->own_offsets[i] = tokens[i].offset;
+    }
+    free_tokens(tokens, count);
+
+    line_index_init(&cache->own_lines);
+    line_index_add(&cache->own_lines, data, 0, length);
+
+    cache->num_tokens = count;
+    cache->codes = cache->own_codes;
+    cache->payloads = cache->own_payloads;
+    cache->offsets = cache->own_offsets;
+    cache->line_starts = cache->own_lines.starts;
+    cache->num_lines = cache->own_lines.count;
+}
+
+// Lex the whole source into the cache's own arrays
+static void lex_all(TokenCache *cache, const char *data, size_t length)
+{
+    if (length >= CACHE_PARALLEL_MIN && lexer_thread_count() > 1)
+    {
+        lex_all_parallel(cache, data, length);
+        return;
+    }
+
+    LexState state;
+    lexer_init(&state, data, length, false);
+    line_index_init(&cache->own_lines);
+    state.lines = &cache->own_lines;
+
+    size_t count = 0;
+    size_t capacity = INITIAL_CACHE_TOKENS;
+    grow_arrays(cache, capacity);
+
+    Token token;
+    while (lexer_next(&state, &token))
+    {
+        if (count >= capacity)
+        {
+            capacity *= 2;
+            grow_arrays(cache, capacity);
+        }
+        cache->own_codes[count] = token_code(&token);
+        cache->own_payloads[count] = token_payload(&token);
+        cache->own_offsets[count] = token.offset;
+        count++;
+    }
+
+    cache->num_tokens = count;
+    cache->codes = cache->own_codes;
+    cache->payloads = cache->own_payloads;
+    cache->offsets = cache->own_offsets;
+    cache->line_starts = cache->own_lines.starts;
+    cache->num_lines = cache->own_lines.count;
+}
+
+// Write to a temporary file and rename it into place, so a concurrent
+// compile never maps half a cache
+static bool store_cache(const TokenCache *cache, const char *dir,
+                        const char *path, uint64_t hash, size_t length)
+{
+    char temp[CACHE_PATH_MAX];
+    if (snprintf(temp, sizeof(temp), "%s.%ld.tmp", path,
+                 (long)getpid()) >= (int)sizeof(temp))
+    {
+        return false;
+    }
+
+    // Every atom so far: the lexer's are all there, in ID order
+    size_t num_atoms = intern_count();
+    size_t string_bytes = 0;
+    for (Atom atom = 1; atom <= num_atoms; atom++)
+        string_bytes += atom_len(atom) + 1;
+    size_t padding = (4 - string_bytes % 4) % 4;
+
+    TokenCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TOKEN_CACHE_MAGIC, 8);
+    header.format = TOKEN_CACHE_FORMAT;
+    header.num_tokens = (uint32_t)cache->num_tokens;
+    header.fingerprint = lexer_fingerprint();
+    header.source_hash = hash;
+    header.source_length = length;
+    header.num_atoms = (uint32_t)num_atoms;
+    header.num_lines = (uint32_t)cache->num_lines;
+    header.string_bytes = (uint32_t)(string_bytes + padding);
+
+    // Lay the body out in memory first; the header carries its hash
+    size_t n = cache->num_tokens;
+    size_t body_size = header.string_bytes +
+                       4 * (2 * n + cache->num_lines) + n;
+    char *body = malloc(body_size);
+    if (!body)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *out = body;
+    for (Atom atom = 1; atom <= num_atoms; atom++)
+    {
+        memcpy(out, atom_str(atom), atom_len(atom) + 1);
+        out += atom_len(atom) + 1;
+    }
+    memset(out, 0, padding);
+    out += padding;
+    memcpy(out, cache->payloads, n * sizeof(uint32_t));
+    out += n * sizeof(uint32_t);
+    memcpy(out, cache->offsets, n * sizeof(uint32_t));
+    out += n * sizeof(uint32_t);
+    memcpy(out, cache->line_starts, cache->num_lines * sizeof(uint32_t));
+    out += cache->num_lines * sizeof(uint32_t);
+    memcpy(out, cache->codes, n * sizeof(TokenCode));
+    header.body_hash = hash_bytes(body, body_size);
+
+    mkdir(dir, 0777); // fopen below reports any real problem
+    FILE *file = fopen(temp, "wb");
+    if (!file)
+    {
+        free(body);
+        return false;
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(body, 1, body_size, file);
+    free(body);
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok || rename(temp, path) != 0)
+    {
+        remove(temp);
+        return false;
+    }
+    return true;
+}
+
+void token_cache_open(TokenCache *cache, const char *dir, const char *data,
+                      size_t length)
+{
+    if (length > UINT32_MAX)
+    {
+        fprintf(stderr, "Source too large: offsets are 32-bit\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memset(cache, 0, sizeof(*cache));
+
+    uint64_t hash = hash_bytes(data, length);
+    char path[CACHE_PATH_MAX];
+    bool named = snprintf(path, sizeof(path), "%s/%016llx.tok", dir,
+                          (unsigned long long)hash) < (int)sizeof(path);
+
+    if (named && load_cache(cache, path, hash, length))
+    {
+        cache->hit = true;
+        return;
+    }
+
+    lex_all(cache, data, length);
+    if (!named || !store_cache(cache, dir, path, hash, length))
+    {
+        fprintf(stderr, "Warning: could not write token cache in '%s'\n",
+                dir);
+    }
+}
+
+void token_cache_close(TokenCache *cache)
+{
+    if (cache->mapping)
+        munmap(cache->mapping, cache->mapping_size);
+    free(cache->own_codes);
+    free(cache->own_payloads);
+    free(cache->own_offsets);
+    if (cache->own_lines.starts)
+        line_index_free(&cache->own_lines);
+    memset(cache, 0, sizeof(*cache));
+}
+
+void token_cache_stream(const TokenCache *cache, TokenStream *ts,
+                        const char *data, size_t length)
+{
+    token_stream_open_resident(ts, data, length, cache->codes,
+                               cache->payloads, cache->offsets,
+                               cache->num_tokens, cache->line_starts,
+                               cache->num_lines);
+}
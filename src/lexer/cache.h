@@ -0,0 +1,46 @@
+#ifndef CACHE_H
+// "If CACHE_H is not defined yet..."
+#define CACHE_H
+// "...define it now."
+
+#include "stream.h"
+
+// Every token of a source, kept on disk between compiles.
+//
+// The cache file is named after a hash of the source bytes and holds, with
+// no pointers in it: a header (format, lexer_fingerprint(), source hash
+// and length, counts), the atom texts as NUL-terminated strings in atom
+// order, then the payload, offset and line-start arrays and the token
+// codes. A later compile of the same bytes maps it and hands the arrays
+// straight to a TokenStream; the lexer never runs. A different source,
+// lexer version or file format just misses, and the file is rewritten.
+typedef struct
+{
+    size_t num_tokens;
+    const TokenCode *codes;
+    const uint32_t *payloads; // int values, or atoms of the global interner
+    const uint32_t *offsets;
+    const uint32_t *line_starts;
+    size_t num_lines;
+    bool hit; // came from disk rather than from lexing now
+
+    // Backing storage: the mapped file, and/or heap arrays
+    void *mapping;
+    size_t mapping_size;
+    TokenCode *own_codes;
+    uint32_t *own_payloads;
+    uint32_t *own_offsets;
+    LineIndex own_lines;
+} TokenCache;
+
+// Tokens of `data` from the cache directory `dir`, or lexed now and stored
+// there for next time. Failing to store them is only a warning.
+void token_cache_open(TokenCache *cache, const char *dir, const char *data,
+                      size_t length);
+void token_cache_close(TokenCache *cache);
+
+// A stream over the cached tokens; close it before the cache
+void token_cache_stream(const TokenCache *cache, TokenStream *ts,
+                        const char *data, size_t length);
+
+#endif // CACHE_H
@@ -0,0 +1,178 @@
+#include "incremental.h"
+
+#define INITIAL_BUFFER_TOKENS 1024
+
+// Make room for at least one more token in the gap
+static void tb_reserve(TokenBuffer *tb)
+{
+    if (tb->gap_start < tb->gap_end)
+        return;
+
+    size_t capacity = tb->capacity ? tb->capacity * 2 : INITIAL_BUFFER_TOKENS;
+    Token *grown = realloc(tb->tokens, capacity * sizeof(Token));
+    if (!grown)
+    {
+        fprintf(stderr, "Reallocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t tail = tb->capacity - tb->gap_end;
+    memmove(grown + capacity - tail, grown + tb->gap_end, tail * sizeof(Token));
+    tb->tokens = grown;
+    tb->gap_end = capacity - tail;
+    tb->capacity = capacity;
+}
+
+// Move the gap so that it starts at token `index`, converting the tokens
+// that cross it between absolute and end-relative positions
+static void tb_move_gap(TokenBuffer *tb, size_t index)
+{
+    while (tb->gap_start > index)
+    {
+        Token *token = &tb->tokens[--tb->gap_end];
+        *token = tb->tokens[--tb->gap_start];
+        token->offset = (uint32_t)(tb->length - token->offset);
+        token->line -= tb->last_line;
+    }
+    while (tb->gap_start < index)
+    {
+        Token *token = &tb->tokens[tb->gap_start++];
+        *token = tb->tokens[tb->gap_end++];
+        token->offset = (uint32_t)(tb->length - token->offset);
+        token->line += tb->last_line;
+    }
+}
+
+Token tb_token(const TokenBuffer *tb, size_t index)
+{
+    if (index < tb->gap_start)
+        return tb->tokens[index];
+
+    Token token = tb->tokens[index + tb->gap_end - tb->gap_start];
+    token.offset = (uint32_t)(tb->length - token.offset);
+    token.line += tb->last_line;
+    return token;
+}
+
+void token_buffer_open(TokenBuffer *tb, const char *data, size_t length)
+{
+    if (length > UINT32_MAX)
+    {
+        fprintf(stderr, "Source too large: offsets are 32-bit\n");
+        exit(EXIT_FAILURE);
+    }
+
+    tb->data = data;
+    tb->length = length;
+    tb->tokens = NULL;
+    tb->gap_start = 0;
+    tb->gap_end = 0;
+    tb->capacity = 0;
+
+    LexState state;
+    lexer_init(&state, data, length, false);
+
+    Token token;
+    while (lexer_next(&state, &token))
+    {
+        tb_reserve(tb);
+        tb->tokens[tb->gap_start++] = token;
+    }
+    tb->last_line = state.line;
+}
+
+void token_buffer_close(TokenBuffer *tb)
+{
+    free(tb->tokens);
+    tb->tokens = NULL;
+    tb->gap_start = 0;
+    tb->gap_end = 0;
+    tb->capacity = 0;
+}
+
+size_t token_buffer_edit(TokenBuffer *tb, const char *data, size_t length,
+                         size_t edit_start, size_t old_end, size_t new_end)
+{
+    if (length > UINT32_MAX)
+    {
+        fprintf(stderr, "Source too large: offsets are 32-bit\n");
+        exit(EXIT_FAILURE);
+    }
+    if (edit_start > old_end || edit_start > new_end ||
+        old_end > tb->length || new_end > length ||
+        tb->length - old_end != length - new_end)
+    {
+        fprintf(stderr, "Invalid edit [%zu, %zu) -> [%zu, %zu)\n",
+                edit_start, old_end, edit_start, new_end);
+        exit(EXIT_FAILURE);
+    }
+
+    // Find the first token at or after the edit. The one before it may run
+    // into the edit ("ab" + "c"), but nothing earlier looks that far ahead.
+    size_t low = 0;
+    size_t high = tb_count(tb);
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (tb_token(tb, mid).offset < edit_start)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    size_t restart = low > 0 ? low - 1 : 0;
+
+    // Everything from the restart token on goes behind the gap, where the
+    // end-relative offsets hold for the new source as well
+    tb_move_gap(tb, restart);
+
+    LexState state;
+    lexer_init(&state, data, length, false);
+    if (low > 0)
+    {
+        Token first = tb_token(tb, restart);
+        state.cursor = data + first.offset;
+        state.line = first.line;
+        state.line_start = state.cursor - (first.col - 1);
+    }
+    tb->data = data;
+    tb->length = length;
+
+    size_t lexed = 0;
+    Token token;
+    while (lexer_next(&state, &token))
+    {
+        lexed++;
+
+        // Old tokens the new lex has passed are gone, and so is anything
+        // that started inside the replaced range
+        size_t distance = length - token.offset;
+        while (tb->gap_end < tb->capacity &&
+               (tb->tokens[tb->gap_end].offset > distance ||
+                tb->tokens[tb->gap_end].offset > length - new_end))
+        {
+            tb->gap_end++;
+        }
+
+        if (tb->gap_end < tb->capacity)
+        {
+            const Token *old = &tb->tokens[tb->gap_end];
+            if (old->offset == distance && old->col == token.col)
+            {
+                // In step again: the rest of the old tokens stand, and only
+                // their line numbers move, all at once
+                tb->last_line = token.line - old->line;
+                return lexed;
+            }
+            if (old->offset == distance)
+                tb->gap_end++;
+        }
+
+        tb_reserve(tb);
+        tb->tokens[tb->gap_start++] = token;
+    }
+
+    // Lexed to the end without meeting the old tokens again
+    tb->gap_end = tb->capacity;
+    tb->last_line = state.line;
+    return lexed;
+}
@@ -0,0 +1,45 @@
+#ifndef INCREMENTAL_H
+// "If INCREMENTAL_H is not defined yet..."
+#define INCREMENTAL_H
+// "...define it now."
+
+#include "lexer.h"
+
+// The tokens of a source that keeps being edited, held in a gap buffer.
+// Tokens before the gap carry ordinary offsets and lines. Tokens after it
+// store their offset relative to the end of the source and their line
+// relative to the last line, so an edit in front of them moves them all
+// at once by changing `length` and `last_line`. Columns are stored as is:
+// a token is only reused when its column still matches.
+typedef struct
+{
+    const char *data; // current source; the caller keeps it alive
+    size_t length;
+    int last_line; // line the lexer ends on
+    Token *tokens;
+    size_t gap_start; // tokens[gap_start, gap_end) is free space
+    size_t gap_end;
+    size_t capacity;
+} TokenBuffer;
+
+// Lex `data` in full
+void token_buffer_open(TokenBuffer *tb, const char *data, size_t length);
+void token_buffer_close(TokenBuffer *tb);
+
+// The source is now `data`, in which [edit_start, new_end) replaced what
+// used to be [edit_start, old_end). Re-lexes from the token the edit
+// touches until a fresh token lands on an old one at the same offset and
+// column, then keeps everything from there. Returns the number of tokens
+// lexed.
+size_t token_buffer_edit(TokenBuffer *tb, const char *data, size_t length,
+                         size_t edit_start, size_t old_end, size_t new_end);
+
+static inline size_t tb_count(const TokenBuffer *tb)
+{
+    return tb->capacity - (tb->gap_end - tb->gap_start);
+}
+
+// Token `index` with its real offset and line
+Token tb_token(const TokenBuffer *tb, size_t index);
+
+#endif // INCREMENTAL_H
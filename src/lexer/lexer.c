@@ -1,134 +1,241 @@
+#include <limits.h>
+#include <stdint.h>
 #include "lexer.h"
+#include "scan.h"
 
 #define INITIAL_TOKEN_CAPACITY 64
-
-// should be local to lexer only hence static
-static int col = 1, line = 1;
-
-void skip_single_line_comment(FILE *file, int *line, int *col)
+#define KEYWORD_HASH_MAX_SLOTS 64
+#define KEYWORD_HASH_SEED_ATTEMPTS 100000
+
+// Trace output is printed only when the LexState asked for it; these expect
+// a local `trace` copied from the state
+#if LEXER_TRACE
+#define LEX_TRACE(...) (trace ? (void)printf(__VA_ARGS__) : (void)0)
+#define LEX_TRACE_TOKEN(token) (trace ? print_token(token) : (void)0)
+#else
+#define LEX_TRACE(...) ((void)0)
+#define LEX_TRACE_TOKEN(token) ((void)0)
+#endif
+
+void skip_single_line_comment(const char **cursor, const char *end,
+                              int *line, const char **line_start)
 {
-    char ch;
-    while ((ch = fgetc(file)) != EOF && ch != '\n')
-    {
-        (*col)++;
-    }
-    if (ch == '\n')
+    const char *p = scan_newline(*cursor, end);
+    if (p < end)
     {
+        // consume the newline as well
+        p++;
         (*line)++;
-        *col = 0;
+        *line_start = p;
     }
+    *cursor = p;
 }
 
-void skip_multi_line_comment(FILE *file, int *line, int *col)
+// False when the comment never closes; the caller reports it
+bool skip_multi_line_comment(const char **cursor, const char *end,
+                             int *line, const char **line_start)
 {
-    int comment_start_line = *line;
-    int comment_start_col = *col - 1;  // The '/' position
-    char ch;
-    
-    while ((ch = fgetc(file)) != EOF)
+    const char *p = *cursor;
+    const char *close = scan_comment_close(p, end);
+
+    if (close < end)
     {
-        (*col)++;
-        if (ch == '\n')
+        const char *last_newline;
+        size_t newlines = scan_count_newlines(p, close, &last_newline);
+        if (newlines > 0)
         {
-            (*line)++;
-            *col = 0;
-        }
-        else if (ch == '*')
-        {
-            char next = fgetc(file);
-            if (next == '/')
-            {
-                (*col)++;
-                return;  // Successfully closed
-            }
-            else if (next != EOF)
-            {
-                ungetc(next, file);
-                (*col)--;
-            }
+            *line += (int)newlines;
+            *line_start = last_newline + 1;
         }
+        *cursor = close + 2;
+        return true;  // Successfully closed
     }
-    
-    // Error message that matches your existing style
-    fprintf(stderr, "ERROR: Unterminated multi-line comment at line %d, "
-                   "col %d - missing closing '*/'\n", 
-                   comment_start_line, comment_start_col);
-    exit(EXIT_FAILURE);
+    return false;
 }
 
-bool is_binary_digit(char ch)
+// Character classes for the table-driven scanner. Each operator character
+// has a class of its own so the operator DFA below can be indexed by class.
+typedef enum
 {
-    return ch == '0' || ch == '1';
-}
-
-int bin_to_digit(char ch)
+    CC_OTHER, // anything we do not recognise, including '\0'
+    CC_SPACE,
+    CC_DIGIT,
+    CC_ALPHA,
+    CC_SEPARATOR,
+    CC_STRAY, // $ # @ ~ `
+    CC_PLUS,
+    CC_MINUS,
+    CC_STAR,
+    CC_SLASH,
+    CC_PERCENT,
+    CC_EQUAL,
+    CC_AMP,
+    CC_PIPE,
+    CC_CARET,
+    CC_BANG,
+    CC_LESS,
+    CC_GREATER,
+    CC_COUNT
+} CharClass;
+
+// DFA states past the operator kinds: "//" and "/*" open comments
+#define STATE_LINE_COMMENT OP_COUNT
+#define STATE_BLOCK_COMMENT (OP_COUNT + 1)
+#define STATE_COUNT (OP_COUNT + 2)
+
+#define DIGIT_NONE 0xFF
+
+// Filled in once by build_lexer_tables()
+static unsigned char char_class[256];
+static unsigned char sep_kind_of[256];
+static unsigned char digit_value[256];        // 0-15, or DIGIT_NONE
+static unsigned char number_prefix_base[256]; // base selected by "0<ch>"
+// op_next[state][class]: state after reading one more character, or OP_NONE
+// when the longest match ends. A state is the OpKind spelled so far.
+static unsigned char op_next[STATE_COUNT][CC_COUNT];
+static bool lexer_tables_ready = false;
+
+// Numbers are read eight digits at a time on little-endian targets
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LEXER_SWAR 1
+#else
+#define LEXER_SWAR 0
+#endif
+
+// Largest literal of each kind. Decimal literals must fit in an int; hex,
+// binary and octal ones may use all 32 bits and become the int with that
+// bit pattern, the way C treats 0xFFFFFFFF.
+#define DECIMAL_LITERAL_MAX ((uint64_t)INT_MAX)
+#define BITS_LITERAL_MAX ((uint64_t)UINT32_MAX)
+
+#if LEXER_SWAR
+// SWAR ("SIMD within a register"): eight source bytes loaded as one
+// little-endian word, so byte 0 holds the first, most significant digit.
+#define SWAR_ONES 0x0101010101010101ULL
+#define SWAR_HIGHS 0x8080808080808080ULL
+
+static const uint64_t swar_pow10[9] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+// High bit of each byte set when lo <= byte <= hi (lo, hi below 0x80)
+static inline uint64_t swar_in_range(uint64_t x, unsigned lo, unsigned hi)
 {
-    return ch - '0';
+    uint64_t low7 = x & (SWAR_ONES * 0x7F);
+    return (SWAR_ONES * (128 + hi) - low7) &
+           (low7 + SWAR_ONES * (128 - lo)) & ~x & SWAR_HIGHS;
 }
 
-bool is_octal_digit(char ch)
+// Number of leading bytes of x that are digits in `base`
+static inline int swar_digit_count(uint64_t x, int base)
 {
-    return ch >= '0' && ch <= '7';
-}
+    uint64_t digits;
 
-int oct_to_digit(char ch)
-{
-    return ch - '0';
-}
+    switch (base)
+    {
+    case 2:
+        digits = swar_in_range(x, '0', '1');
+        break;
+    case 8:
+        digits = swar_in_range(x, '0', '7');
+        break;
+    case 10:
+        digits = swar_in_range(x, '0', '9');
+        break;
+    default:
+        digits = swar_in_range(x, '0', '9') |
+                 swar_in_range(x | (SWAR_ONES * 0x20), 'a', 'f');
+        break;
+    }
 
-bool is_decimal_digit(char ch)
-{
-    return isdigit((unsigned char)ch);
+    uint64_t stops = ~digits & SWAR_HIGHS;
+    return stops ? __builtin_ctzll(stops) / 8 : 8;
 }
 
-int dec_to_digit(char ch)
+// Value of the first `count` (1-8) digits of x. Each byte becomes its
+// digit value, then neighbouring lanes are merged pairwise: 8 digits ->
+// 4 two-digit lanes -> 2 four-digit lanes -> 1 eight-digit value.
+static inline uint64_t swar_digits_value(uint64_t x, int count, int base)
 {
-    return ch - '0';
+    uint64_t b = (uint64_t)base;
+    // '0'-'9' -> 0-9, 'a'-'f' and 'A'-'F' -> 10-15
+    uint64_t v = (x & (SWAR_ONES * 0x0F)) + 9 * ((x >> 6) & SWAR_ONES);
+
+    // Drop the bytes past the literal; zeros shift in as leading digits
+    v <<= 8 * (8 - count);
+    v = ((v * (b << 8 | 1)) >> 8) & 0x00FF00FF00FF00FFULL;
+    v = ((v * (b * b << 16 | 1)) >> 16) & 0x0000FFFF0000FFFFULL;
+    return (v * (b * b * b * b << 32 | 1)) >> 32;
 }
+#endif
 
-bool is_hex_digit(char ch)
+// Digit loop shared by parse_number_in_base; inlined once per base so the
+// SWAR masks and multipliers are constants
+static inline __attribute__((always_inline)) uint64_t
+read_digits(const char **cursor, const char *end, int base, uint64_t number)
 {
-    return isdigit((unsigned char)ch) ||
-           (ch >= 'a' && ch <= 'f') ||
-           (ch >= 'A' && ch <= 'F');
-}
+    const char *p = *cursor;
 
-int hex_to_digit(char ch)
-{
-    if (isdigit((unsigned char)ch))
-        return ch - '0';
-    else if (ch >= 'a' && ch <= 'f')
-        return ch - 'a' + 10;
-    else // (ch >= 'A' && ch <= 'F')
-        return ch - 'A' + 10;
-}
+    while (p < end)
+    {
+        unsigned digit = digit_value[(unsigned char)*p];
+        if (digit >= (unsigned)base)
+            break;
+#if LEXER_SWAR
+        if (end - p >= 8)
+        {
+            // At least one digit: the byte just checked
+            uint64_t word;
+            memcpy(&word, p, sizeof(word));
+            int count = swar_digit_count(word, base);
 
-typedef bool (*IsValidDigitFunc)(char);
-typedef int (*CharToDigitFunc)(char);
+            if (number <= BITS_LITERAL_MAX)
+            {
+                uint64_t scale = base == 10
+                                     ? swar_pow10[count]
+                                     : 1ULL << (__builtin_ctz(base) * count);
+                number = number * scale +
+                         swar_digits_value(word, count, base);
+            }
+            p += count;
+            if (count < 8)
+                break;
+            continue;
+        }
+#endif
+        if (number <= BITS_LITERAL_MAX)
+            number = number * base + digit;
+        p++;
+    }
 
-int parse_number_in_base(FILE *file, int *col, int base,
-                         IsValidDigitFunc is_valid, CharToDigitFunc to_digit,
-                         char initial_digit)
+    *cursor = p;
+    return number;
+}
+
+// Reads the digits after `initial_digit`, stopping at the first non-digit
+// without consuming it. Values past 32 bits come back as
+// BITS_LITERAL_MAX + 1 so the caller can reject them.
+uint64_t parse_number_in_base(const char **cursor, const char *end, int base,
+                              char initial_digit)
 {
-    int number = to_digit(initial_digit);
-    char ch;
+    uint64_t number = digit_value[(unsigned char)initial_digit];
 
-    while ((ch = fgetc(file)) != EOF)
+    switch (base)
     {
-        if (is_valid(ch))
-        {
-            number = number * base + to_digit(ch);
-            (*col)++;
-        }
-        else
-        {
-            ungetc(ch, file);
-            (*col)--;
-            break;
-        }
+    case 2:
+        number = read_digits(cursor, end, 2, number);
+        break;
+    case 8:
+        number = read_digits(cursor, end, 8, number);
+        break;
+    case 10:
+        number = read_digits(cursor, end, 10, number);
+        break;
+    default:
+        number = read_digits(cursor, end, 16, number);
+        break;
     }
 
-    return number;
+    return number > BITS_LITERAL_MAX ? BITS_LITERAL_MAX + 1 : number;
 }
 
 void print_token(Token token)
@@ -157,432 +264,709 @@ void print_token(Token token)
     }
 }
 
-int generate_number(char ch, FILE *file, int *col)
+// False for a malformed or out-of-range literal. That is reported and
+// ends compilation unless `quiet` is set. (line, col) is where `ch` was.
+bool generate_number(char ch, const char **cursor, const char *end, int line,
+                     int col, bool quiet, int *value)
 {
-    int number = 0;
+    uint64_t number = 0;
+    uint64_t max = DECIMAL_LITERAL_MAX;
+    const char *start = *cursor - 1;
+    const char *p = *cursor;
 
     if (ch == '0')
     {
-        int next = fgetc(file);
-        (*col)++;
+        char next = p < end ? *p : '\0';
+        int base = number_prefix_base[(unsigned char)next];
 
-        if (next == 'x' || next == 'X')
+        if (base == 16 || base == 2)
         {
-            char first = fgetc(file);
-            (*col)++;
-            if (!is_hex_digit(first))
+            // Skip the x/b marker; at least one digit must follow
+            p++;
+            if (p >= end || digit_value[(unsigned char)*p] >= base)
             {
-                fprintf(stderr, "Invalid hex literal at line %d, \
+                if (quiet)
+                    return false;
+                fprintf(stderr, "Invalid %s literal at line %d, \
                     col %d\n",
-                        line, *col);
+                        base == 16 ? "hex" : "binary", line, col + 2);
                 exit(EXIT_FAILURE);
             }
-            number = parse_number_in_base(file, col, 16,
-                                          is_hex_digit, hex_to_digit, first);
+            char first = *p++;
+            number = parse_number_in_base(&p, end, base, first);
+            max = BITS_LITERAL_MAX;
         }
-        else if (next == 'b' || next == 'B')
+        else if (base == 8)
         {
-            char first = fgetc(file);
-            (*col)++;
-            if (!is_binary_digit(first))
-            {
-                fprintf(stderr, "Invalid binary literal at line %d, \
-                    col %d\n",
-                        line, *col);
-                exit(EXIT_FAILURE);
-            }
-            number = parse_number_in_base(file, col, 2,
-                                          is_binary_digit, bin_to_digit, first);
-        }
-        else if (is_octal_digit(next))
-        {
-            number = parse_number_in_base(file, col, 8,
-                                          is_octal_digit, oct_to_digit, next);
+            p++;
+            number = parse_number_in_base(&p, end, 8, next);
+            max = BITS_LITERAL_MAX;
         }
         else
         {
-            ungetc(next, file);
-            (*col)--;
+            // A lone '0'; whatever follows belongs to the next token
             number = 0;
         }
     }
-    // else if (isdigit(ch))
-    // {
-    //     number = parse_number_in_base(file, col, 10,
-    //                                   is_decimal_digit, dec_to_digit);
-    // }
-    // else
-    // {
-    //     number = 0;
-    // }
     else
     {
-        number = parse_number_in_base(file, col, 10,
-                                      is_decimal_digit, dec_to_digit, ch);
+        number = parse_number_in_base(&p, end, 10, ch);
     }
 
-    return number;
+    if (number > max)
+    {
+        if (quiet)
+            return false;
+        fprintf(stderr, "Integer literal '%.*s' out of range at line %d, "
+                        "col %d (max %llu)\n",
+                (int)(p - start), start, line, col,
+                (unsigned long long)max);
+        exit(EXIT_FAILURE);
+    }
+
+    *cursor = p;
+    *value = (int)(uint32_t)number;
+    return true;
 }
 
-int read_identifier(char first_char, FILE *file, int *col, char *buffer,
-                    size_t buf_size)
+static const char *const op_texts[OP_COUNT] = {
+    [OP_ADD] = "+",          [OP_SUB] = "-",         [OP_MUL] = "*",
+    [OP_DIV] = "/",          [OP_MOD] = "%",         [OP_SHL] = "<<",
+    [OP_SHR] = ">>",         [OP_LT] = "<",          [OP_LE] = "<=",
+    [OP_GT] = ">",           [OP_GE] = ">=",         [OP_EQ] = "==",
+    [OP_NE] = "!=",          [OP_BIT_AND] = "&",     [OP_BIT_XOR] = "^",
+    [OP_BIT_OR] = "|",       [OP_AND] = "&&",        [OP_OR] = "||",
+    [OP_NOT] = "!",          [OP_INC] = "++",        [OP_DEC] = "--",
+    [OP_ASSIGN] = "=",       [OP_ADD_ASSIGN] = "+=", [OP_SUB_ASSIGN] = "-=",
+    [OP_MUL_ASSIGN] = "*=",  [OP_DIV_ASSIGN] = "/=", [OP_MOD_ASSIGN] = "%=",
+    [OP_SHL_ASSIGN] = "<<=", [OP_SHR_ASSIGN] = ">>=",
+};
+
+const char *op_kind_text(OpKind op)
 {
-    int length = 0;
-    char ch;
+    if (op <= OP_NONE || op >= OP_COUNT)
+        return NULL;
+    return op_texts[op];
+}
 
-    buffer[length++] = first_char;
+static void set_char_class(const char *chars, CharClass cls)
+{
+    for (; *chars; chars++)
+        char_class[(unsigned char)*chars] = (unsigned char)cls;
+}
+
+static void build_lexer_tables(void)
+{
+    memset(char_class, CC_OTHER, sizeof(char_class));
+    set_char_class(" \t\n\v\f\r", CC_SPACE);
+    set_char_class("0123456789", CC_DIGIT);
+    set_char_class("abcdefghijklmnopqrstuvwxyz"
+                   "ABCDEFGHIJKLMNOPQRSTUVWXYZ", CC_ALPHA);
+    set_char_class(";,(){}", CC_SEPARATOR);
+    set_char_class("$#@~`", CC_STRAY);
+    set_char_class("+", CC_PLUS);
+    set_char_class("-", CC_MINUS);
+    set_char_class("*", CC_STAR);
+    set_char_class("/", CC_SLASH);
+    set_char_class("%", CC_PERCENT);
+    set_char_class("=", CC_EQUAL);
+    set_char_class("&", CC_AMP);
+    set_char_class("|", CC_PIPE);
+    set_char_class("^", CC_CARET);
+    set_char_class("!", CC_BANG);
+    set_char_class("<", CC_LESS);
+    set_char_class(">", CC_GREATER);
+
+    memset(sep_kind_of, SEP_NONE, sizeof(sep_kind_of));
+    sep_kind_of[';'] = SEP_SEMICOLON;
+    sep_kind_of[','] = SEP_COMMA;
+    sep_kind_of['('] = SEP_LPAREN;
+    sep_kind_of[')'] = SEP_RPAREN;
+    sep_kind_of['{'] = SEP_LBRACE;
+    sep_kind_of['}'] = SEP_RBRACE;
+
+    memset(digit_value, DIGIT_NONE, sizeof(digit_value));
+    for (int d = 0; d < 10; d++)
+        digit_value['0' + d] = (unsigned char)d;
+    for (int d = 0; d < 6; d++)
+    {
+        digit_value['a' + d] = (unsigned char)(10 + d);
+        digit_value['A' + d] = (unsigned char)(10 + d);
+    }
 
-    while ((ch = fgetc(file)) != EOF && isalnum(ch))
+    memset(number_prefix_base, 0, sizeof(number_prefix_base));
+    number_prefix_base['x'] = number_prefix_base['X'] = 16;
+    number_prefix_base['b'] = number_prefix_base['B'] = 2;
+    for (int d = 0; d < 8; d++)
+        number_prefix_base['0' + d] = 8;
+
+    // Operator DFA, generated from op_texts. Every proper prefix of an
+    // operator is itself an operator, so each operator adds exactly one
+    // edge out of the state for its prefix. Shorter spellings go first.
+    memset(op_next, OP_NONE, sizeof(op_next));
+    for (size_t length = 1; length <= 3; length++)
     {
-        if (length < (int)(buf_size - 1))
+        for (int op = OP_NONE + 1; op < OP_COUNT; op++)
         {
-            buffer[length++] = ch;
+            const char *text = op_texts[op];
+            if (strlen(text) != length)
+                continue;
+
+            unsigned state = OP_NONE;
+            size_t i;
+            for (i = 0; i + 1 < length; i++)
+            {
+                state = op_next[state][char_class[(unsigned char)text[i]]];
+                if (state == OP_NONE)
+                    break;
+            }
+            if (i + 1 < length)
+            {
+                fprintf(stderr, "Operator '%s' has no shorter prefix "
+                                "operator\n",
+                        text);
+                exit(EXIT_FAILURE);
+            }
+            op_next[state][char_class[(unsigned char)text[length - 1]]] =
+                (unsigned char)op;
         }
-        (*col)++;
     }
+    op_next[OP_DIV][CC_SLASH] = STATE_LINE_COMMENT;
+    op_next[OP_DIV][CC_STAR] = STATE_BLOCK_COMMENT;
 
-    buffer[length] = '\0';
+    lexer_tables_ready = true;
+}
 
-    if (ch != EOF)
+size_t number_literal_length(const char *text, const char *end)
+{
+    if (!lexer_tables_ready)
+        build_lexer_tables();
+
+    const char *p = text + 1;
+    int base = 10;
+    if (*text == '0')
     {
-        ungetc(ch, file);
-        (*col)--;
+        base = p < end ? number_prefix_base[(unsigned char)*p] : 0;
+        if (base == 0)
+            return 1; // a lone '0'
+        if (base != 8)
+            p++; // the x/b marker; octal digits follow the '0' directly
     }
+    while (p < end && digit_value[(unsigned char)*p] < base)
+        p++;
+    return (size_t)(p - text);
+}
 
-    return length;
+static const char *const keyword_texts[KW_COUNT] = {
+#define X(name, text, node) [KW_##name] = text,
+    KEYWORD_LIST(X)
+#undef X
+};
+
+static const size_t keyword_lengths[KW_COUNT] = {
+#define X(name, text, node) [KW_##name] = sizeof(text) - 1,
+    KEYWORD_LIST(X)
+#undef X
+};
+
+// Perfect hash over (length, first char, last char), generated from
+// KEYWORD_LIST the first time it is needed. The smallest table that admits a
+// collision-free seed is used, which for the current keywords is minimal
+// (one slot per keyword).
+static KeywordKind keyword_slots[KEYWORD_HASH_MAX_SLOTS];
+static uint32_t keyword_seed = 0;
+static uint32_t keyword_slot_count = 0; // 0 until the table is built
+
+static inline uint32_t keyword_hash(size_t length, char first, char last,
+                                    uint32_t seed, uint32_t slot_count)
+{
+    uint32_t key = (uint32_t)(unsigned char)first |
+                   (uint32_t)(unsigned char)last << 8 |
+                   (uint32_t)length << 16;
+    // Multiplicative hash, reduced to [0, slot_count) from the high bits
+    return (uint32_t)(((uint64_t)(key * seed) * slot_count) >> 32);
 }
 
-void free_tokens(Token *tokens, size_t num_tokens)
+static bool try_keyword_seed(uint32_t seed, uint32_t slot_count)
 {
-    if (!tokens)
-        return;
+    memset(keyword_slots, 0, sizeof(keyword_slots));
+    for (int kw = KW_NONE + 1; kw < KW_COUNT; kw++)
+    {
+        const char *text = keyword_texts[kw];
+        size_t length = keyword_lengths[kw];
+        uint32_t slot = keyword_hash(length, text[0], text[length - 1],
+                                     seed, slot_count);
+        if (keyword_slots[slot] != KW_NONE)
+            return false;
+        keyword_slots[slot] = (KeywordKind)kw;
+    }
+    return true;
+}
 
-    for (size_t i = 0; i < num_tokens; ++i)
+static void build_keyword_table(void)
+{
+    // The hash only sees length and the outer characters, so those must
+    // tell every keyword apart
+    for (int a = KW_NONE + 1; a < KW_COUNT; a++)
     {
-        // Free string values if token type uses str_val
-        if (tokens[i].type == KEYWORD ||
-            tokens[i].type == SEPARATOR ||
-            tokens[i].type == IDENTIFIER ||
-            tokens[i].type == OPERATOR)
+        for (int b = a + 1; b < KW_COUNT; b++)
         {
-            if (tokens[i].value.str_val)
+            size_t length = keyword_lengths[a];
+            if (length == keyword_lengths[b] &&
+                keyword_texts[a][0] == keyword_texts[b][0] &&
+                keyword_texts[a][length - 1] == keyword_texts[b][length - 1])
             {
-                free(tokens[i].value.str_val);
-                tokens[i].value.str_val = NULL;
+                fprintf(stderr, "Keywords '%s' and '%s' share length and "
+                                "first/last character\n",
+                        keyword_texts[a], keyword_texts[b]);
+                exit(EXIT_FAILURE);
             }
         }
     }
 
-    free(tokens);
+    for (uint32_t slot_count = KW_COUNT - 1;
+         slot_count <= KEYWORD_HASH_MAX_SLOTS; slot_count++)
+    {
+        for (uint32_t attempt = 0; attempt < KEYWORD_HASH_SEED_ATTEMPTS;
+             attempt++)
+        {
+            uint32_t seed = 2654435761u + 2u * attempt; // odd multipliers
+            if (try_keyword_seed(seed, slot_count))
+            {
+                keyword_seed = seed;
+                keyword_slot_count = slot_count;
+                return;
+            }
+        }
+    }
+
+    fprintf(stderr, "Failed to build keyword hash table\n");
+    exit(EXIT_FAILURE);
 }
 
-Token *lexer(FILE *file, size_t *num_tokens_out)
+KeywordKind keyword_lookup(const char *text, size_t length)
 {
-    size_t capacity = INITIAL_TOKEN_CAPACITY;
-    size_t count = 0;
-    Token *tokens = malloc(capacity * sizeof(Token));
-    if (!tokens)
+    if (keyword_slot_count == 0)
+        build_keyword_table();
+    if (length == 0)
+        return KW_NONE;
+
+    KeywordKind kw = keyword_slots[keyword_hash(length, text[0],
+                                                text[length - 1],
+                                                keyword_seed,
+                                                keyword_slot_count)];
+    if (kw != KW_NONE && keyword_lengths[kw] == length &&
+        memcmp(keyword_texts[kw], text, length) == 0)
     {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
+        return kw;
     }
+    return KW_NONE;
+}
+
+const char *keyword_text(KeywordKind kw)
+{
+    if (kw <= KW_NONE || kw >= KW_COUNT)
+        return NULL;
+    return keyword_texts[kw];
+}
 
-    char ch = fgetc(file);
-    while (ch != EOF)
+// FNV-1a, continuing from `hash`
+static uint64_t fingerprint_bytes(uint64_t hash, const void *bytes,
+                                  size_t length)
+{
+    const unsigned char *p = bytes;
+    for (size_t i = 0; i < length; i++)
     {
-        if (count >= capacity)
-        {
-            capacity *= 2;
-            tokens = realloc(tokens, capacity * sizeof(Token));
-            if (!tokens)
-            {
-                fprintf(stderr, "Reallocation failed\n");
-                exit(EXIT_FAILURE);
-            }
-        }
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+uint64_t lexer_fingerprint(void)
+{
+    if (keyword_slot_count == 0)
+        build_keyword_table();
+    if (!lexer_tables_ready)
+        build_lexer_tables();
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    int version = LEXER_VERSION;
+    hash = fingerprint_bytes(hash, &version, sizeof(version));
+    hash = fingerprint_bytes(hash, char_class, sizeof(char_class));
+    hash = fingerprint_bytes(hash, sep_kind_of, sizeof(sep_kind_of));
+    hash = fingerprint_bytes(hash, digit_value, sizeof(digit_value));
+    hash = fingerprint_bytes(hash, number_prefix_base,
+                             sizeof(number_prefix_base));
+    hash = fingerprint_bytes(hash, op_next, sizeof(op_next));
+    for (int kw = KW_NONE + 1; kw < KW_COUNT; kw++)
+    {
+        // Include the terminator so "in" + "tif" differs from "int" + "if"
+        hash = fingerprint_bytes(hash, keyword_texts[kw],
+                                 keyword_lengths[kw] + 1);
+    }
+    return hash;
+}
 
-        if (ch == '\n')
+// Record the newlines in [from, to) in the state's line index, if it keeps
+// one
+static inline void note_lines(const LexState *state, const char *from,
+                              const char *to)
+{
+    if (state->lines)
+    {
+        line_index_add(state->lines, state->start,
+                       (size_t)(from - state->start),
+                       (size_t)(to - state->start));
+    }
+}
+
+// Point the token at the canonical interned copy of its text, in the
+// state's own interner if it has one
+static void set_token_text(const LexState *state, Token *token,
+                           const char *text, size_t length)
+{
+    if (state->atoms)
+    {
+        token->atom = interner_intern_n(state->atoms, text, length);
+        token->value.str_val = interner_str(state->atoms, token->atom);
+        return;
+    }
+    token->atom = intern_n(text, length);
+    token->value.str_val = atom_str(token->atom);
+}
+
+void free_tokens(Token *tokens, size_t num_tokens)
+{
+    // Token strings belong to the interner (see intern_free_all)
+    (void)num_tokens;
+    free(tokens);
+}
+
+#if LEXER_TRACE
+// Per-character messages for a run of blanks and newlines starting at (line,
+// col); only prints, the caller advances the position itself
+static void trace_whitespace(const char *run, const char *run_end, int line,
+                             int col)
+{
+    for (const char *s = run; s < run_end; s++)
+    {
+        if (s > run)
+            col++;
+        if (*s == '\n')
         {
-            // Token token;
-            // token.type = SEPARATOR;
-            // token.value.str_val = strdup("new line");
-            // token.col = col;
-            // token.line = line;
             printf("Found new line at line %d and col %d\n", line, col);
-            // print_token(token);
-            // tokens[count++] = token;
             line++;
             col = 0;
-            // col = 1;
-            // ch = fgetc(file);
-            // continue;
         }
-
-        else if (isspace(ch))
+        else
         {
-            // Token token;
-            // token.type = SEPARATOR;
-            // char temp[2] = {ch, '\0'};
-            // token.value.str_val = strdup(temp);
-            // token.col = col;
-            // token.line = line;
             printf("Found whitespace at line %d and col %d\n", line, col);
-            // print_token(token);
-            // tokens[count++] = token;
         }
+    }
+}
+#endif
 
-        else if (ch == ';')
-        {
-            Token token;
-            token.type = SEPARATOR;
-            token.value.str_val = strdup(";");
-            token.col = col;
-            token.line = line;
-            printf("Found Semicolon at line %d and col %d\n",
-                   line, col);
-            print_token(token);
-            tokens[count++] = token;
-        }
+void lexer_init(LexState *state, const char *data, size_t length, bool trace)
+{
+    // Shared tables are built here, before any concurrent use
+    if (keyword_slot_count == 0)
+        build_keyword_table();
+    if (!lexer_tables_ready)
+        build_lexer_tables();
+    scan_init();
+
+    state->start = data;
+    state->cursor = data;
+    state->end = data + length;
+    state->limit = state->end;
+    state->line = 1;
+    state->line_start = data;
+    state->lines = NULL;
+    state->trace = trace;
+    state->atoms = NULL;
+    state->speculative = false;
+    state->failed = false;
+}
 
-        else if (ch == ',')
-        {
-            Token token;
-            token.type = SEPARATOR;
-            token.value.str_val = strdup(",");
-            token.col = col;
-            token.line = line;
-            printf("Found COMMA at line %d and col %d\n", line, col);
-            print_token(token);
-            tokens[count++] = token;
-        }
+bool lexer_next(LexState *state, Token *out)
+{
+    const char *p = state->cursor;
+    const char *end = state->end;
+    int line = state->line;
+    const char *line_start = state->line_start;
+    bool trace = state->trace;
+    bool emitted = false;
+    const char *token_start = p;
 
-        else if (ch == '(')
-        {
-            Token token;
-            token.type = SEPARATOR;
-            token.value.str_val = strdup("(");
-            token.col = col;
-            token.line = line;
-            printf("Found OPEN_PARENTHESIS %c at line %d and col %d\n",
-                   ch, line, col);
-            print_token(token);
-            tokens[count++] = token;
-        }
+    (void)trace; // unused when LEXER_TRACE is 0
+
+    while (!emitted && p < end)
+    {
+        if (p >= state->limit)
+            break;
+        token_start = p;
+        char ch = *p++;
+        // Columns come from the line start; nothing is counted per byte
+        int col = (int)(token_start - line_start) + 1;
+
+        CharClass cls = (CharClass)char_class[(unsigned char)ch];
 
-        else if (ch == '{')
+        switch (cls)
         {
-            Token token;
-            token.type = SEPARATOR;
-            token.value.str_val = strdup("{");
-            token.col = col;
-            token.line = line;
-            printf("Found OPEN_PARENTHESIS %c at line %d and col %d\n",
-                   ch, line, col);
-            print_token(token);
-            tokens[count++] = token;
+        case CC_SPACE:
+        {
+            // Newlines and blanks: swallow the whole run in one go
+            const char *run = p - 1;
+            const char *run_end = scan_not_space(p, end);
+#if LEXER_TRACE
+            if (trace)
+                trace_whitespace(run, run_end, line, col);
+#endif
+            const char *last_newline;
+            size_t newlines = scan_count_newlines(run, run_end, &last_newline);
+            if (newlines > 0)
+            {
+                line += (int)newlines;
+                line_start = last_newline + 1;
+                note_lines(state, run, line_start);
+            }
+            p = run_end;
+            break;
         }
 
-        else if (ch == ')')
+        case CC_SEPARATOR:
         {
             Token token;
             token.type = SEPARATOR;
-            token.value.str_val = strdup(")");
+            set_token_text(state, &token, p - 1, 1);
+            token.kind.sep = (SepKind)sep_kind_of[(unsigned char)ch];
             token.col = col;
             token.line = line;
-            printf("Found CLOSED_PARENTHESIS %c at line %d and col %d\n",
-                   ch, line, col);
-            print_token(token);
-            tokens[count++] = token;
+            switch (token.kind.sep)
+            {
+            case SEP_SEMICOLON:
+                LEX_TRACE("Found Semicolon at line %d and col %d\n",
+                          line, col);
+                break;
+            case SEP_COMMA:
+                LEX_TRACE("Found COMMA at line %d and col %d\n", line, col);
+                break;
+            case SEP_LPAREN:
+            case SEP_LBRACE:
+                LEX_TRACE("Found OPEN_PARENTHESIS %c at line %d "
+                          "and col %d\n",
+                          ch, line, col);
+                break;
+            default:
+                LEX_TRACE("Found CLOSED_PARENTHESIS %c at line %d "
+                          "and col %d\n",
+                          ch, line, col);
+                break;
+            }
+            LEX_TRACE_TOKEN(token);
+            *out = token;
+            emitted = true;
+            break;
         }
 
-        else if (ch == '}')
+        case CC_DIGIT:
         {
             Token token;
-            token.type = SEPARATOR;
-            token.value.str_val = strdup("}");
+            token.type = INT;
+            token.atom = ATOM_NONE;
+            token.kind.op = OP_NONE;
+            if (!generate_number(ch, &p, end, line, col, state->speculative,
+                                 &token.value.int_val))
+            {
+                goto speculation_failed;
+            }
             token.col = col;
             token.line = line;
-            printf("Found CLOSED_PARENTHESIS %c at line %d and col %d\n",
-                   ch, line, col);
-            print_token(token);
-            tokens[count++] = token;
+            LEX_TRACE("Found number = %d at line %d and col %d\n",
+                      token.value.int_val, line, col);
+            LEX_TRACE_TOKEN(token);
+            *out = token;
+            emitted = true;
+            break;
         }
 
-        else if (ch == '/')
+        case CC_ALPHA:
         {
-            int start_col = col;
-            char next = fgetc(file);
-            col++;
+            // The name is interned straight from the source: no copy, and
+            // no limit on its length
+            const char *name = p - 1;
+            p = scan_not_ident(p, end);
+            size_t length = (size_t)(p - name);
 
-            if (next == '/')
-            {
-                // Single-line comment - skip it
-                skip_single_line_comment(file, &line, &col);
-            }
-            else if (next == '*')
+            Token token;
+            KeywordKind kw = keyword_lookup(name, length);
+            if (kw != KW_NONE)
             {
-                // Multi-line comment - skip it
-                skip_multi_line_comment(file, &line, &col);
+                token.type = KEYWORD;
+                token.kind.kw = kw;
+                set_token_text(state, &token, name, length);
+                token.col = col;
+                token.line = line;
+                LEX_TRACE("Found keyword '%s' at line %d and col %d\n",
+                          token.value.str_val, line, col);
+                LEX_TRACE_TOKEN(token);
             }
             else
             {
-                // Division operator (/ or /=)
-                char op[3] = {'/', '\0', '\0'};
-
-                if (next == '=')
+#if LEXER_TRACE
+                for (size_t i = 0; trace && i < length; i++)
                 {
-                    op[1] = '='; // /= operator
-                }
-                else
-                {
-                    ungetc(next, file); // Put back the character
-                    col--;
+                    printf("Found character = %c at line %d and col %d\n",
+                           name[i], line, col + (int)i);
                 }
-
-                Token token;
-                token.type = OPERATOR;
-                token.value.str_val = strdup(op);
-                token.col = start_col;
+#endif
+                token.type = IDENTIFIER;
+                token.kind.op = OP_NONE;
+                set_token_text(state, &token, name, length);
+                token.col = col;
                 token.line = line;
-                print_token(token);
-                tokens[count++] = token;
+                LEX_TRACE_TOKEN(token);
             }
+            *out = token;
+            emitted = true;
+            break;
         }
 
-        // else if (strchr("+-*/%=&|^!<>", ch))
-        else if (strchr("+-*%=&|^!<>", ch))
-        {
-            int start_col = col;
-            char op[4] = {ch, '\0', '\0', '\0'}; // Max 3-char operators
-            char next = fgetc(file);
-            col++;
+        case CC_STRAY:
+            if (state->speculative)
+                goto speculation_failed;
+            printf("ERROR: stray special character '%c' at "
+                   "line %d, col %d\n",
+                   ch, line, col);
+            exit(EXIT_FAILURE);
 
-            // Check for 2-char or 3-char operators
-            if ((ch == '+' && next == '=') ||
-                (ch == '+' && next == '+') ||
-                (ch == '-' && next == '=') ||
-                (ch == '-' && next == '-') ||
-                (ch == '*' && next == '=') ||
-                // (ch == '/' && next == '=') ||
-                (ch == '%' && next == '=') ||
-                (ch == '=' && next == '=') ||
-                (ch == '!' && next == '=') ||
-                (ch == '<' && next == '=') ||
-                (ch == '>' && next == '=') ||
-                (ch == '&' && next == '&') ||
-                (ch == '|' && next == '|') ||
-                (ch == '<' && next == '<') ||
-                (ch == '>' && next == '>'))
-            {
-                op[1] = next;
+        case CC_OTHER:
+            if (state->speculative)
+                goto speculation_failed;
+            printf("ERROR: unrecognized token '%c' (ASCII %d) at "
+                   "line %d, col %d\n",
+                   ch, (int)ch, line, col);
+            exit(EXIT_FAILURE);
 
-                // Check for <<= or >>=
-                if ((op[0] == '<' && op[1] == '<') ||
-                    (op[0] == '>' && op[1] == '>'))
-                {
-                    char third = fgetc(file);
-                    col++;
-                    if (third == '=')
-                    {
-                        op[2] = '=';
-                    }
-                    else
-                    {
-                        ungetc(third, file);
-                        col--;
-                    }
-                }
-            }
-            else
+        default:
+        {
+            // Operator characters: follow the DFA to the longest operator,
+            // or into a comment for "//" and "/*"
+            const char *start = p - 1;
+            unsigned op_state = op_next[OP_NONE][cls];
+            while (p < end)
             {
-                ungetc(next, file);
-                col--;
+                unsigned char next_class = char_class[(unsigned char)*p];
+                unsigned next = op_next[op_state][next_class];
+                if (next == OP_NONE)
+                    break;
+                op_state = next;
+                p++;
             }
 
-            Token token;
-            token.type = OPERATOR;
-            token.value.str_val = strdup(op);
-            token.col = start_col;
-            token.line = line;
-            print_token(token);
-            tokens[count++] = token;
-        }
-
-        else if (isdigit(ch))
-        {
-            int start_col = col;
-            col++;
-            Token token;
-            token.type = INT;
-            token.value.int_val = generate_number(ch, file, &col);
-            token.col = start_col;
-            token.line = line;
-            printf("Found number = %d at line %d and col %d\n",
-                   token.value.int_val, line, start_col);
-            print_token(token);
-            tokens[count++] = token;
-        }
-
-        else if (isalpha(ch))
-        {
-            char buffer[32];
-            int start_col = col;
-            col++;
-            int length = read_identifier(ch, file, &col, buffer, sizeof(buffer));
-
-            Token token;
-            if ((strcmp(buffer, "exit") == 0) ||
-                strcmp(buffer, "int") == 0 ||
-                strcmp(buffer, "if") == 0 ||
-                strcmp(buffer, "else") == 0 ||
-                strcmp(buffer, "while") == 0 ||
-                strcmp(buffer, "do") == 0)
+            if (op_state == STATE_LINE_COMMENT)
             {
-                token.type = KEYWORD;
-                token.value.str_val = strdup(buffer);
-                token.col = start_col;
-                token.line = line;
-                printf("Found keyword '%s' at line %d and col %d\n",
-                       token.value.str_val, line, start_col);
-                print_token(token);
+                skip_single_line_comment(&p, end, &line, &line_start);
+                if (line_start == p) // ended at a newline
+                    note_lines(state, p - 1, p);
             }
-            else
+            else if (op_state == STATE_BLOCK_COMMENT)
             {
-                for (int i = 0; i < length; i++)
+                if (!skip_multi_line_comment(&p, end, &line, &line_start))
                 {
-                    printf("Found character = %c at line %d and col %d\n",
-                           buffer[i], line, start_col + i);
+                    if (state->speculative)
+                        goto speculation_failed;
+                    fprintf(stderr, "ERROR: Unterminated multi-line comment "
+                                    "at line %d, col %d - missing closing "
+                                    "'*/'\n",
+                            line, col);
+                    exit(EXIT_FAILURE);
                 }
-                token.type = IDENTIFIER;
-                token.value.str_val = strdup(buffer);
-                token.col = start_col;
+                if (line_start > start)
+                    note_lines(state, start, line_start);
+            }
+            else
+            {
+                Token token;
+                token.type = OPERATOR;
+                set_token_text(state, &token, start, (size_t)(p - start));
+                token.kind.op = (OpKind)op_state;
+                token.col = col;
                 token.line = line;
-                print_token(token);
+                LEX_TRACE_TOKEN(token);
+                *out = token;
+                emitted = true;
             }
-            tokens[count++] = token;
+            break;
         }
+        }
+    }
 
-        else
+    if (emitted)
+    {
+        out->offset = (uint32_t)(token_start - state->start);
+        out->length = (uint32_t)(p - token_start);
+    }
+    state->cursor = p;
+    state->line = line;
+    state->line_start = line_start;
+    return emitted;
+
+speculation_failed:
+    // Step over the first byte of the offending input so a speculative lex
+    // can carry on; `failed` tells the caller there was nothing to emit
+    state->cursor = token_start + 1;
+    state->line = line;
+    state->line_start = line_start;
+    state->failed = true;
+    return false;
+}
+
+Token *lexer_buffer(const char *data, size_t length, size_t *num_tokens_out)
+{
+    size_t capacity = INITIAL_TOKEN_CAPACITY;
+    size_t count = 0;
+    Token *tokens = malloc(capacity * sizeof(Token));
+    if (!tokens)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    LexState state;
+    lexer_init(&state, data, length, true);
+
+    Token token;
+    while (lexer_next(&state, &token))
+    {
+        if (count >= capacity)
         {
-            if (strchr("$#@~`", ch))
-            {
-                printf("ERROR: stray special character '%c' at "
-                       "line %d, col %d\n",
-                       ch, line, col);
-            }
-            else
+            capacity *= 2;
+            tokens = realloc(tokens, capacity * sizeof(Token));
+            if (!tokens)
             {
-                printf("ERROR: unrecognized token '%c' (ASCII %d) at "
-                       "line %d, col %d\n",
-                       ch, (int)ch, line, col);
+                fprintf(stderr, "Reallocation failed\n");
+                exit(EXIT_FAILURE);
             }
-            exit(EXIT_FAILURE);
         }
-
-        ch = fgetc(file);
-        col++;
+        tokens[count++] = token;
     }
 
     *num_tokens_out = count;
     return tokens;
+}
+
+Token *lexer(FILE *file, size_t *num_tokens_out)
+{
+    SourceBuffer source;
+    if (source_read_stream(file, &source) != 0)
+    {
+        fprintf(stderr, "Failed to read source\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Token *tokens = lexer_buffer(source.data, source.length, num_tokens_out);
+    source_close(&source);
+    return tokens;
 }
\ No newline at end of file
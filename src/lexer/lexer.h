@@ -8,6 +8,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "source.h"
+#include "lines.h"
+#include "../intern/intern.h"
 
 typedef enum
 {
@@ -19,20 +23,145 @@ typedef enum
     STRING_LITERAL
 } TokenType;
 
+// Dense operator codes filled in by the lexer so the parser can switch and
+// index tables instead of comparing strings
+typedef enum
+{
+    OP_NONE,
+    OP_ADD,         // +
+    OP_SUB,         // -
+    OP_MUL,         // *
+    OP_DIV,         // /
+    OP_MOD,         // %
+    OP_SHL,         // <<
+    OP_SHR,         // >>
+    OP_LT,          // <
+    OP_LE,          // <=
+    OP_GT,          // >
+    OP_GE,          // >=
+    OP_EQ,          // ==
+    OP_NE,          // !=
+    OP_BIT_AND,     // &
+    OP_BIT_XOR,     // ^
+    OP_BIT_OR,      // |
+    OP_AND,         // &&
+    OP_OR,          // ||
+    OP_NOT,         // !
+    OP_INC,         // ++
+    OP_DEC,         // --
+    OP_ASSIGN,      // =
+    OP_ADD_ASSIGN,  // +=
+    OP_SUB_ASSIGN,  // -=
+    OP_MUL_ASSIGN,  // *=
+    OP_DIV_ASSIGN,  // /=
+    OP_MOD_ASSIGN,  // %=
+    OP_SHL_ASSIGN,  // <<=
+    OP_SHR_ASSIGN,  // >>=
+    OP_COUNT
+} OpKind;
+
+typedef enum
+{
+    SEP_NONE,
+    SEP_SEMICOLON, // ;
+    SEP_COMMA,     // ,
+    SEP_LPAREN,    // (
+    SEP_RPAREN,    // )
+    SEP_LBRACE,    // {
+    SEP_RBRACE,    // }
+    SEP_COUNT
+} SepKind;
+
+// Every keyword is declared here and nowhere else:
+// X(kind suffix, spelling, parser node type)
+// The lexer builds its perfect hash from this list and the parser derives
+// its keyword -> NodeType table from it, so new entries get both for free.
+#define KEYWORD_LIST(X)                           \
+    X(EXIT, "exit", NODE_EXIT_CALL)               \
+    X(INT, "int", NODE_TYPE_SPECIFIER)            \
+    X(IF, "if", NODE_IF_STATEMENT)                \
+    X(ELSE, "else", NODE_ELSE_STATEMENT)          \
+    X(WHILE, "while", NODE_WHILE_STATEMENT)       \
+    X(DO, "do", NODE_DO_WHILE_STATEMENT)
+
+typedef enum
+{
+    KW_NONE,
+#define X(name, text, node) KW_##name,
+    KEYWORD_LIST(X)
+#undef X
+    KW_COUNT
+} KeywordKind;
+
 typedef struct
 {
     TokenType type;
+    Atom atom; // interned text, ATOM_NONE for INT
     union
     {
         int int_val;
-        char *str_val;
+        const char *str_val; // canonical pointer, equal to atom_str(atom)
     } value;
     int line;
     int col;
+    uint32_t offset; // byte offset of the first character in the source
+    uint32_t length; // the token's text is source[offset, offset + length)
+    union
+    {
+        OpKind op;      // OPERATOR
+        SepKind sep;    // SEPARATOR
+        KeywordKind kw; // KEYWORD
+    } kind;
 } Token;
 
+// Bump whenever lexer_next can produce different tokens for the same
+// source; it is part of lexer_fingerprint(), so token caches notice
+#define LEXER_VERSION 2
+
+// Build with -DLEXER_TRACE=0 to drop the per-character debug output; the
+// bulk scanners only pay off once it is gone.
+#ifndef LEXER_TRACE
+#define LEXER_TRACE 1
+#endif
+
+// Position of an in-progress lex. It is small and plain, so copying it is
+// enough to resume lexing later from the same point (see TokenStream).
+typedef struct
+{
+    const char *start;  // first byte of the source
+    const char *cursor; // next byte to read
+    const char *end;
+    const char *limit; // lexer_next stops at a token starting here or later
+    int line;
+    const char *line_start; // first byte of `line`; columns count from it
+    LineIndex *lines;       // records every line start crossed, if set
+    bool trace;             // print the per-character debug output
+    Interner *atoms;  // where token text is interned; NULL: the global one
+    bool speculative; // may start inside a comment: stop, don't report
+    bool failed;      // last call skipped what would have been an error
+} LexState;
+
+void lexer_init(LexState *state, const char *data, size_t length, bool trace);
+// Lex the next token into *token; false once the input is exhausted (or,
+// when speculative, after stepping over an error: see `failed`)
+bool lexer_next(LexState *state, Token *token);
+
+// Tokenise an in-memory source (see source_open for the mmap input mode)
+Token *lexer_buffer(const char *data, size_t length, size_t *num_tokens_out);
+// Tokenise whatever is left in `file`; reads it into memory first
 Token *lexer(FILE *file, size_t *num_tokens_out);
 void print_token(Token token);
+// Source spelling of an operator, e.g. "<<=" for OP_SHL_ASSIGN
+const char *op_kind_text(OpKind op);
+// KW_NONE unless `text` spells a keyword; one hash probe plus one memcmp
+KeywordKind keyword_lookup(const char *text, size_t length);
+const char *keyword_text(KeywordKind kw);
+// Bytes spanned by the number literal at `text`, which lexed without error;
+// every other token's text is its atom, so only numbers need this
+size_t number_literal_length(const char *text, const char *end);
+// Hash of LEXER_VERSION and the lexer's tables (character classes, operator
+// DFA, keywords): changes whenever the tokens for a source might
+uint64_t lexer_fingerprint(void);
 void free_tokens(Token *tokens, size_t num_tokens);
 
 #endif // LEXER_H
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lines.h"
+#include "scan.h"
+
+#define INITIAL_LINE_CAPACITY 1024
+
+void line_index_init(LineIndex *index)
+{
+    index->starts = malloc(INITIAL_LINE_CAPACITY * sizeof(uint32_t));
+    if (!index->starts)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    index->starts[0] = 0;
+    index->count = 1;
+    index->capacity = INITIAL_LINE_CAPACITY;
+    index->last = 0;
+}
+
+void line_index_free(LineIndex *index)
+{
+    free(index->starts);
+    index->starts = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+
+void line_index_assign(LineIndex *index, const uint32_t *starts,
+                       size_t count)
+{
+    if (count > index->capacity)
+    {
+        uint32_t *grown = realloc(index->starts, count * sizeof(uint32_t));
+        if (!grown)
+        {
+            fprintf(stderr, "Reallocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        index->starts = grown;
+        index->capacity = count;
+    }
+    memcpy(index->starts, starts, count * sizeof(uint32_t));
+    index->count = count;
+    index->last = 0;
+}
+
+void line_index_add(LineIndex *index, const char *data, size_t from,
+                    size_t to)
+{
+    // Everything before the newest line start is in already
+    size_t known = index->starts[index->count - 1];
+    if (from < known)
+        from = known;
+
+    const char *end = data + to;
+    for (const char *p = scan_newline(data + from, end); p < end;
+         p = scan_newline(p + 1, end))
+    {
+        if (index->count >= index->capacity)
+        {
+            size_t capacity = index->capacity * 2;
+            uint32_t *grown = realloc(index->starts,
+                                      capacity * sizeof(uint32_t));
+            if (!grown)
+            {
+                fprintf(stderr, "Reallocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            index->starts = grown;
+            index->capacity = capacity;
+        }
+        index->starts[index->count++] = (uint32_t)(p + 1 - data);
+    }
+}
+
+void line_index_locate(LineIndex *index, uint32_t offset, int *line,
+                       int *col)
+{
+    const uint32_t *starts = index->starts;
+    size_t found = index->last;
+
+    // The parser mostly asks about the line it asked about last time
+    if (!(starts[found] <= offset &&
+          (found + 1 == index->count || offset < starts[found + 1])))
+    {
+        // Last line starting at or before `offset`
+        size_t low = 0;
+        size_t high = index->count;
+        while (high - low > 1)
+        {
+            size_t mid = low + (high - low) / 2;
+            if (starts[mid] <= offset)
+                low = mid;
+            else
+                high = mid;
+        }
+        found = low;
+        index->last = found;
+    }
+
+    *line = (int)found + 1;
+    *col = (int)(offset - starts[found]) + 1;
+}
@@ -0,0 +1,36 @@
+#ifndef LINES_H
+// "If LINES_H is not defined yet..."
+#define LINES_H
+// "...define it now."
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Offsets at which each line starts, recorded by the lexer as it crosses
+// newlines. Turning an offset into a line and column is a binary search,
+// done only when a diagnostic or a token printout asks for it.
+typedef struct
+{
+    uint32_t *starts; // starts[0] is 0, starts[n] is the start of line n + 1
+    size_t count;
+    size_t capacity;
+    size_t last; // line found by the previous lookup; nearby ones check it
+} LineIndex;
+
+void line_index_init(LineIndex *index);
+void line_index_free(LineIndex *index);
+// Replace the record with a copy of `count` line starts (starts[0] is 0)
+void line_index_assign(LineIndex *index, const uint32_t *starts,
+                       size_t count);
+
+// Record the newlines in data[from, to). Offsets already covered are
+// skipped, so re-lexing a stretch adds nothing.
+void line_index_add(LineIndex *index, const char *data, size_t from,
+                    size_t to);
+
+// Line and column (both from 1) of `offset`, which must not lie past the
+// recorded newlines' line
+void line_index_locate(LineIndex *index, uint32_t offset, int *line,
+                       int *col);
+
+#endif // LINES_H
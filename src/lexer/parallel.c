@@ -0,0 +1,422 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "parallel.h"
+#include "scan.h"
+
+#define MAX_LEX_THREADS 64
+#define INITIAL_CHUNK_TOKENS 1024
+
+// Where a speculative lex stepped over an error: after `index` tokens,
+// lexing from `before` would report it
+typedef struct
+{
+    size_t index;
+    LexState before;
+} LexError;
+
+// One newline-aligned slice of the source and what its worker made of it
+typedef struct
+{
+    size_t begin; // byte range [begin, end)
+    size_t end;
+    LexState state; // lines from 1 at `begin`; ends where lexing stopped
+    Interner *atoms;
+    Token *tokens;
+    size_t count;
+    LexError *errors;
+    size_t num_errors;
+    int line_base; // newlines before `begin`
+    int newlines;  // newlines in [begin, end)
+
+    // Filled in by the stitching pass
+    bool kept;        // some of the tokens belong to the result
+    size_t keep_from; // first token the real lex agrees with
+    size_t keep_to;   // end of the kept tokens
+    Atom *remap;      // chunk atom -> global atom
+    const char **remap_str; // chunk atom -> global atom's text
+    Token *out;       // where tokens[keep_from..] go in the result
+} LexChunk;
+
+// A stretch of the result: kept chunk tokens, or tokens re-lexed by the
+// stitching pass (chunk == NULL)
+typedef struct
+{
+    LexChunk *chunk;
+    size_t from; // into chunk->tokens or the re-lexed tokens
+    size_t count;
+} LexSegment;
+
+typedef struct
+{
+    Token *tokens;
+    size_t count;
+    size_t capacity;
+} TokenList;
+
+static void token_list_push(TokenList *list, const Token *token)
+{
+    if (list->count >= list->capacity)
+    {
+        size_t capacity = list->capacity ? list->capacity * 2
+                                         : INITIAL_CHUNK_TOKENS;
+        Token *grown = realloc(list->tokens, capacity * sizeof(Token));
+        if (!grown)
+        {
+            fprintf(stderr, "Reallocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        list->tokens = grown;
+        list->capacity = capacity;
+    }
+    list->tokens[list->count++] = *token;
+}
+
+int lexer_thread_count(void)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > 0 ? (int)cpus : 1;
+
+    const char *env = getenv("TOYCC_LEX_THREADS");
+    if (env && atoi(env) > 0)
+        threads = atoi(env);
+    return threads > MAX_LEX_THREADS ? MAX_LEX_THREADS : threads;
+}
+
+// Worker: lex one chunk speculatively into its own token list
+static void *lex_chunk(void *arg)
+{
+    LexChunk *chunk = arg;
+    TokenList list = {NULL, 0, 0};
+    size_t error_capacity = 0;
+    Token token;
+
+    for (;;)
+    {
+        LexState before = chunk->state;
+        if (lexer_next(&chunk->state, &token))
+        {
+            token_list_push(&list, &token);
+            continue;
+        }
+        if (!chunk->state.failed)
+            break;
+
+        // Most likely text inside a comment that began in an earlier
+        // chunk. Note it in case it turns out to be real, and carry on.
+        chunk->state.failed = false;
+        if (chunk->num_errors >= error_capacity)
+        {
+            error_capacity = error_capacity ? error_capacity * 2 : 8;
+            LexError *grown = realloc(chunk->errors,
+                                      error_capacity * sizeof(LexError));
+            if (!grown)
+            {
+                fprintf(stderr, "Reallocation failed\n");
+                exit(EXIT_FAILURE);
+            }
+            chunk->errors = grown;
+        }
+        chunk->errors[chunk->num_errors++] = (LexError){list.count, before};
+    }
+
+    const char *last_newline;
+    chunk->newlines = (int)scan_count_newlines(chunk->state.start +
+                                                   chunk->begin,
+                                               chunk->state.start +
+                                                   chunk->end,
+                                               &last_newline);
+    chunk->tokens = list.tokens;
+    chunk->count = list.count;
+    return NULL;
+}
+
+// Worker: copy a chunk's kept tokens into the result with global atoms and
+// absolute line numbers
+static void *place_chunk(void *arg)
+{
+    LexChunk *chunk = arg;
+    Token *out = chunk->out;
+
+    for (size_t t = chunk->keep_from; t < chunk->keep_to; t++)
+    {
+        Token token = chunk->tokens[t];
+        token.line += chunk->line_base;
+        if (token.atom != ATOM_NONE)
+        {
+            token.value.str_val = chunk->remap_str[token.atom];
+            token.atom = chunk->remap[token.atom];
+        }
+        *out++ = token;
+    }
+    return NULL;
+}
+
+// Run `work` on every kept chunk (all chunks for the lexing phase), one
+// thread each; chunk 0 runs on the calling thread
+static void run_chunks(LexChunk *chunks, size_t num_chunks,
+                       void *(*work)(void *), bool kept_only)
+{
+    pthread_t threads[MAX_LEX_THREADS];
+    bool started[MAX_LEX_THREADS] = {false};
+
+    for (size_t c = 1; c < num_chunks; c++)
+    {
+        if (kept_only && !chunks[c].kept)
+            continue;
+        started[c] = pthread_create(&threads[c], NULL, work,
+                                    &chunks[c]) == 0;
+        if (!started[c])
+            work(&chunks[c]); // no thread to spare: do it here
+    }
+
+    if (num_chunks > 0 && (!kept_only || chunks[0].kept))
+        work(&chunks[0]);
+
+    for (size_t c = 1; c < num_chunks; c++)
+    {
+        if (started[c])
+            pthread_join(threads[c], NULL);
+    }
+}
+
+// Give the chunk's atoms global IDs in the order a sequential lex would
+// first have interned them
+static void adopt_atoms(LexChunk *chunk)
+{
+    size_t count = interner_count(chunk->atoms);
+    chunk->remap = calloc(count + 1, sizeof(Atom));
+    chunk->remap_str = calloc(count + 1, sizeof(const char *));
+    if (!chunk->remap || !chunk->remap_str)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (chunk->keep_from == 0 && chunk->keep_to == chunk->count)
+    {
+        // Chunk atoms are numbered by first use already
+        for (Atom atom = 1; atom <= count; atom++)
+        {
+            chunk->remap[atom] = intern_n(interner_str(chunk->atoms, atom),
+                                          interner_len(chunk->atoms, atom));
+            chunk->remap_str[atom] = atom_str(chunk->remap[atom]);
+        }
+        return;
+    }
+
+    // Skipped tokens may have introduced atoms first; go by the kept ones
+    for (size_t t = chunk->keep_from; t < chunk->keep_to; t++)
+    {
+        Atom atom = chunk->tokens[t].atom;
+        if (atom != ATOM_NONE && chunk->remap[atom] == ATOM_NONE)
+        {
+            chunk->remap[atom] = intern_n(interner_str(chunk->atoms, atom),
+                                          interner_len(chunk->atoms, atom));
+            chunk->remap_str[atom] = atom_str(chunk->remap[atom]);
+        }
+    }
+}
+
+static void push_segment(LexSegment **segments, size_t *count,
+                         size_t *capacity, LexSegment segment)
+{
+    if (*count >= *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 16;
+        LexSegment *grown = realloc(*segments,
+                                    *capacity * sizeof(LexSegment));
+        if (!grown)
+        {
+            fprintf(stderr, "Reallocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        *segments = grown;
+    }
+    (*segments)[(*count)++] = segment;
+}
+
+Token *lexer_buffer_parallel(const char *data, size_t length, int threads,
+                             size_t *num_tokens_out)
+{
+    // The real, sequential lex; also builds the shared tables before any
+    // worker starts
+    LexState real;
+    lexer_init(&real, data, length, false);
+
+    if (threads <= 0)
+        threads = lexer_thread_count();
+    if (threads > MAX_LEX_THREADS)
+        threads = MAX_LEX_THREADS;
+    if ((size_t)threads > length / PARALLEL_MIN_CHUNK)
+        threads = length / PARALLEL_MIN_CHUNK > 0
+                      ? (int)(length / PARALLEL_MIN_CHUNK)
+                      : 1;
+
+    Token token;
+    if (threads == 1)
+    {
+        // Nothing to split: lex in place and skip the stitching
+        TokenList list = {NULL, 0, 0};
+        while (lexer_next(&real, &token))
+            token_list_push(&list, &token);
+        if (!list.tokens)
+        {
+            Token none = {0};
+            token_list_push(&list, &none);
+            list.count = 0;
+        }
+        *num_tokens_out = list.count;
+        return list.tokens;
+    }
+
+    LexChunk chunks[MAX_LEX_THREADS];
+    size_t num_chunks = 0;
+    size_t begin = 0;
+
+    // Cut just after the first newline past each even split point
+    while (begin < length && num_chunks < (size_t)threads)
+    {
+        size_t end = length;
+        if (num_chunks + 1 < (size_t)threads)
+        {
+            size_t target = length / threads * (num_chunks + 1);
+            if (target < begin)
+                target = begin;
+            const char *newline = scan_newline(data + target, data + length);
+            if (newline < data + length)
+                end = (size_t)(newline + 1 - data);
+        }
+
+        LexChunk *chunk = &chunks[num_chunks++];
+        chunk->begin = begin;
+        chunk->end = end;
+        chunk->atoms = interner_create();
+        chunk->state = real;
+        chunk->state.cursor = data + begin;
+        chunk->state.line_start = data + begin;
+        chunk->state.limit = data + end;
+        chunk->state.atoms = chunk->atoms;
+        chunk->state.speculative = true;
+        chunk->tokens = NULL;
+        chunk->count = 0;
+        chunk->errors = NULL;
+        chunk->num_errors = 0;
+        chunk->kept = false;
+        chunk->remap = NULL;
+        chunk->remap_str = NULL;
+        begin = end;
+    }
+
+    run_chunks(chunks, num_chunks, lex_chunk, false);
+
+    int line_base = 0;
+    for (size_t c = 0; c < num_chunks; c++)
+    {
+        chunks[c].line_base = line_base;
+        line_base += chunks[c].newlines;
+    }
+
+    // Stitch: lex for real until a token lands on one a worker produced
+    // at the same offset. From there that worker's tokens are what a
+    // sequential lex gives, so skip to where it stopped. Normally each
+    // chunk syncs on its first token; a comment cut in two costs a re-lex
+    // up to the first token after it.
+    TokenList relexed = {NULL, 0, 0};
+    LexSegment *segments = NULL;
+    size_t num_segments = 0;
+    size_t segment_capacity = 0;
+    size_t total = 0;
+    size_t c = 0;
+    size_t j = 0;
+
+    while (lexer_next(&real, &token))
+    {
+        while (c + 1 < num_chunks && token.offset >= chunks[c + 1].begin)
+        {
+            c++;
+            j = 0;
+        }
+
+        LexChunk *chunk = &chunks[c];
+        while (j < chunk->count && chunk->tokens[j].offset < token.offset)
+            j++;
+
+        if (j < chunk->count && chunk->tokens[j].offset == token.offset)
+        {
+            // Keep tokens up to the first error the worker stepped over
+            // after this point; the real lex reports that one itself
+            const LexState *resume = &chunk->state;
+            chunk->keep_to = chunk->count;
+            for (size_t e = 0; e < chunk->num_errors; e++)
+            {
+                if (chunk->errors[e].index > j)
+                {
+                    chunk->keep_to = chunk->errors[e].index;
+                    resume = &chunk->errors[e].before;
+                    break;
+                }
+            }
+
+            chunk->kept = true;
+            chunk->keep_from = j;
+            adopt_atoms(chunk);
+            push_segment(&segments, &num_segments, &segment_capacity,
+                         (LexSegment){chunk, j, chunk->keep_to - j});
+            total += chunk->keep_to - j;
+
+            // Carry on from there in real mode
+            real.cursor = resume->cursor;
+            real.line = resume->line + chunk->line_base;
+            real.line_start = resume->line_start;
+            j = chunk->count;
+            continue;
+        }
+
+        if (num_segments == 0 || segments[num_segments - 1].chunk != NULL)
+        {
+            push_segment(&segments, &num_segments, &segment_capacity,
+                         (LexSegment){NULL, relexed.count, 0});
+        }
+        segments[num_segments - 1].count++;
+        token_list_push(&relexed, &token);
+        total++;
+    }
+
+    Token *tokens = malloc((total > 0 ? total : 1) * sizeof(Token));
+    if (!tokens)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    Token *out = tokens;
+    for (size_t s = 0; s < num_segments; s++)
+    {
+        if (segments[s].chunk)
+        {
+            segments[s].chunk->out = out;
+        }
+        else
+        {
+            memcpy(out, relexed.tokens + segments[s].from,
+                   segments[s].count * sizeof(Token));
+        }
+        out += segments[s].count;
+    }
+
+    run_chunks(chunks, num_chunks, place_chunk, true);
+
+    for (size_t k = 0; k < num_chunks; k++)
+    {
+        free(chunks[k].tokens);
+        free(chunks[k].errors);
+        free(chunks[k].remap);
+        free(chunks[k].remap_str);
+        interner_destroy(chunks[k].atoms);
+    }
+    free(segments);
+    free(relexed.tokens);
+
+    *num_tokens_out = total;
+    return tokens;
+}
@@ -0,0 +1,26 @@
+#ifndef PARALLEL_H
+// "If PARALLEL_H is not defined yet..."
+#define PARALLEL_H
+// "...define it now."
+
+#include "lexer.h"
+
+// Chunks smaller than this are not worth a thread of their own
+#ifndef PARALLEL_MIN_CHUNK
+#define PARALLEL_MIN_CHUNK (256 * 1024)
+#endif
+
+// Worker threads lexer_buffer_parallel uses when asked for 0: the number of
+// online CPUs, capped by TOYCC_LEX_THREADS in the environment
+int lexer_thread_count(void);
+
+// Same tokens as lexer_buffer (without the debug trace), lexed by up to
+// `threads` workers. The source is cut into chunks at newlines; each worker
+// lexes one chunk speculatively, as if no comment were open at its start,
+// into its own interner. A sequential pass then stitches the chunks
+// together, re-lexing only where a /* */ comment ran across a cut, and
+// shifts every chunk's line numbers by the newlines before it.
+Token *lexer_buffer_parallel(const char *data, size_t length, int threads,
+                             size_t *num_tokens_out);
+
+#endif // PARALLEL_H
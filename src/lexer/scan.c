@@ -0,0 +1,401 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SCAN_X86 0
+#endif
+
+static inline bool is_space_byte(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool is_ident_byte(unsigned char c)
+{
+    return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+
+// Scalar reference versions; also finish the tails of the vector loops
+
+static const char *scalar_newline(const char *p, const char *end)
+{
+    while (p < end && *p != '\n')
+        p++;
+    return p;
+}
+
+static const char *scalar_comment_close(const char *p, const char *end)
+{
+    for (; end - p >= 2; p++)
+    {
+        if (p[0] == '*' && p[1] == '/')
+            return p;
+    }
+    return end;
+}
+
+static const char *scalar_not_space(const char *p, const char *end)
+{
+    while (p < end && is_space_byte((unsigned char)*p))
+        p++;
+    return p;
+}
+
+static const char *scalar_not_ident(const char *p, const char *end)
+{
+    while (p < end && is_ident_byte((unsigned char)*p))
+        p++;
+    return p;
+}
+
+static size_t scalar_count_newlines(const char *p, const char *end,
+                                    const char **last_newline)
+{
+    size_t count = 0;
+    const char *last = NULL;
+    for (; p < end; p++)
+    {
+        if (*p == '\n')
+        {
+            count++;
+            last = p;
+        }
+    }
+    *last_newline = last;
+    return count;
+}
+
+static const ScanKernels scalar_kernels = {
+    scalar_newline,
+    scalar_comment_close,
+    scalar_not_space,
+    scalar_not_ident,
+    scalar_count_newlines,
+};
+
+#if SCAN_X86
+
+// Byte classes are tested with signed compares: every byte >= 0x80 is
+// negative and falls outside the ASCII ranges we look for.
+
+// SSE2: 16 bytes per step
+
+#define SSE2 __attribute__((target("sse2")))
+
+SSE2 static inline unsigned sse2_space_mask(__m128i v)
+{
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i ctrl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                 _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(space, ctrl));
+}
+
+SSE2 static inline unsigned sse2_digit_mask(__m128i v)
+{
+    return (unsigned)_mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                      _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1))));
+}
+
+SSE2 static inline unsigned sse2_ident_mask(__m128i v)
+{
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    return (unsigned)_mm_movemask_epi8(alpha) | sse2_digit_mask(v);
+}
+
+SSE2 static const char *sse2_newline(const char *p, const char *end)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scalar_newline(p, end);
+}
+
+SSE2 static const char *sse2_comment_close(const char *p, const char *end)
+{
+    const __m128i star = _mm_set1_epi8('*');
+    const __m128i slash = _mm_set1_epi8('/');
+    // Compare each byte and its successor, so keep one byte of lookahead
+    while (end - p >= 17)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, star), _mm_cmpeq_epi8(b, slash)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scalar_comment_close(p, end);
+}
+
+SSE2 static const char *sse2_not_space(const char *p, const char *end)
+{
+    while (end - p >= 16)
+    {
+        unsigned mask = sse2_space_mask(_mm_loadu_si128((const __m128i *)p)) ^
+                        0xFFFFu;
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scalar_not_space(p, end);
+}
+
+SSE2 static const char *sse2_not_ident(const char *p, const char *end)
+{
+    while (end - p >= 16)
+    {
+        unsigned mask = sse2_ident_mask(_mm_loadu_si128((const __m128i *)p)) ^
+                        0xFFFFu;
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scalar_not_ident(p, end);
+}
+
+SSE2 static size_t sse2_count_newlines(const char *p, const char *end,
+                                       const char **last_newline)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+    size_t count = 0;
+    const char *last = NULL;
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, newline));
+        if (mask)
+        {
+            count += (size_t)__builtin_popcount(mask);
+            last = p + (31 - __builtin_clz(mask));
+        }
+        p += 16;
+    }
+
+    const char *tail_last;
+    count += scalar_count_newlines(p, end, &tail_last);
+    *last_newline = tail_last ? tail_last : last;
+    return count;
+}
+
+static const ScanKernels sse2_kernels = {
+    sse2_newline,
+    sse2_comment_close,
+    sse2_not_space,
+    sse2_not_ident,
+    sse2_count_newlines,
+};
+
+// AVX2: 32 bytes per step
+
+#define AVX2 __attribute__((target("avx2,popcnt")))
+
+AVX2 static inline unsigned avx2_space_mask(__m256i v)
+{
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i ctrl = _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+    return (unsigned)_mm256_movemask_epi8(_mm256_or_si256(space, ctrl));
+}
+
+AVX2 static inline unsigned avx2_digit_mask(__m256i v)
+{
+    return (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('0' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), v)));
+}
+
+AVX2 static inline unsigned avx2_ident_mask(__m256i v)
+{
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(
+        _mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    return (unsigned)_mm256_movemask_epi8(alpha) | avx2_digit_mask(v);
+}
+
+AVX2 static const char *avx2_newline(const char *p, const char *end)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask =
+            (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return sse2_newline(p, end);
+}
+
+AVX2 static const char *avx2_comment_close(const char *p, const char *end)
+{
+    const __m256i star = _mm256_set1_epi8('*');
+    const __m256i slash = _mm256_set1_epi8('/');
+    while (end - p >= 33)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + 1));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_and_si256(
+            _mm256_cmpeq_epi8(a, star), _mm256_cmpeq_epi8(b, slash)));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return sse2_comment_close(p, end);
+}
+
+AVX2 static const char *avx2_not_space(const char *p, const char *end)
+{
+    while (end - p >= 32)
+    {
+        unsigned mask =
+            ~avx2_space_mask(_mm256_loadu_si256((const __m256i *)p));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return sse2_not_space(p, end);
+}
+
+AVX2 static const char *avx2_not_ident(const char *p, const char *end)
+{
+    while (end - p >= 32)
+    {
+        unsigned mask =
+            ~avx2_ident_mask(_mm256_loadu_si256((const __m256i *)p));
+        if (mask)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return sse2_not_ident(p, end);
+}
+
+AVX2 static size_t avx2_count_newlines(const char *p, const char *end,
+                                       const char **last_newline)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+    size_t count = 0;
+    const char *last = NULL;
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask =
+            (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, newline));
+        if (mask)
+        {
+            count += (size_t)__builtin_popcount(mask);
+            last = p + (31 - __builtin_clz(mask));
+        }
+        p += 32;
+    }
+
+    const char *tail_last;
+    count += sse2_count_newlines(p, end, &tail_last);
+    *last_newline = tail_last ? tail_last : last;
+    return count;
+}
+
+static const ScanKernels avx2_kernels = {
+    avx2_newline,
+    avx2_comment_close,
+    avx2_not_space,
+    avx2_not_ident,
+    avx2_count_newlines,
+};
+
+#endif // SCAN_X86
+
+const ScanKernels *scan_kernels = &scalar_kernels;
+
+// should be local to the scanner only hence static
+static ScanLevel current_level = SCAN_SCALAR;
+static bool scan_ready = false;
+
+static ScanLevel best_supported_level(void)
+{
+#if SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt"))
+        return SCAN_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return SCAN_SSE2;
+#endif
+    return SCAN_SCALAR;
+}
+
+ScanLevel scan_set_level(ScanLevel level)
+{
+    ScanLevel best = best_supported_level();
+    if (level > best)
+        level = best;
+
+    switch (level)
+    {
+#if SCAN_X86
+    case SCAN_AVX2:
+        scan_kernels = &avx2_kernels;
+        break;
+    case SCAN_SSE2:
+        scan_kernels = &sse2_kernels;
+        break;
+#endif
+    default:
+        level = SCAN_SCALAR;
+        scan_kernels = &scalar_kernels;
+        break;
+    }
+
+    current_level = level;
+    scan_ready = true;
+    return level;
+}
+
+void scan_init(void)
+{
+    if (scan_ready)
+        return;
+
+    ScanLevel level = SCAN_AVX2;
+    const char *env = getenv("TOYCC_SCAN");
+    if (env && strcmp(env, "scalar") == 0)
+        level = SCAN_SCALAR;
+    else if (env && strcmp(env, "sse2") == 0)
+        level = SCAN_SSE2;
+
+    scan_set_level(level);
+}
+
+ScanLevel scan_level(void)
+{
+    return current_level;
+}
+
+const char *scan_level_name(ScanLevel level)
+{
+    switch (level)
+    {
+    case SCAN_AVX2:
+        return "avx2";
+    case SCAN_SSE2:
+        return "sse2";
+    default:
+        return "scalar";
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef SCAN_H
+// "If SCAN_H is not defined yet..."
+#define SCAN_H
+// "...define it now."
+
+#include <stddef.h>
+
+// Bulk byte scanners used by the lexer's hot loops. Each has a scalar
+// version plus SSE2 and AVX2 kernels that look at 16/32 bytes per step;
+// scan_init() picks the widest one the CPU supports.
+typedef enum
+{
+    SCAN_SCALAR,
+    SCAN_SSE2,
+    SCAN_AVX2
+} ScanLevel;
+
+typedef struct
+{
+    // First '\n' in [p, end), or end
+    const char *(*newline)(const char *p, const char *end);
+    // The '*' of the first "*/" in [p, end), or end
+    const char *(*comment_close)(const char *p, const char *end);
+    // First byte that is not isspace() (newlines included), or end
+    const char *(*not_space)(const char *p, const char *end);
+    // First byte that is not [A-Za-z0-9], or end
+    const char *(*not_ident)(const char *p, const char *end);
+    // Number of '\n' in [p, end); *last_newline gets the last one (or NULL)
+    size_t (*count_newlines)(const char *p, const char *end,
+                             const char **last_newline);
+} ScanKernels;
+
+extern const ScanKernels *scan_kernels;
+
+// Select kernels from CPU features. Safe to call more than once.
+// TOYCC_SCAN=scalar|sse2|avx2 in the environment caps the level.
+void scan_init(void);
+// Force a level (clamped to what the CPU supports); returns the level used
+ScanLevel scan_set_level(ScanLevel level);
+ScanLevel scan_level(void);
+const char *scan_level_name(ScanLevel level);
+
+static inline const char *scan_newline(const char *p, const char *end)
+{
+    return scan_kernels->newline(p, end);
+}
+
+static inline const char *scan_comment_close(const char *p, const char *end)
+{
+    return scan_kernels->comment_close(p, end);
+}
+
+static inline const char *scan_not_space(const char *p, const char *end)
+{
+    return scan_kernels->not_space(p, end);
+}
+
+static inline const char *scan_not_ident(const char *p, const char *end)
+{
+    return scan_kernels->not_ident(p, end);
+}
+
+static inline size_t scan_count_newlines(const char *p, const char *end,
+                                         const char **last_newline)
+{
+    return scan_kernels->count_newlines(p, end, last_newline);
+}
+
+#endif // SCAN_H
@@ -0,0 +1,96 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "source.h"
+
+#define READ_CHUNK_SIZE 65536
+
+int source_read_stream(FILE *file, SourceBuffer *src)
+{
+    size_t capacity = READ_CHUNK_SIZE;
+    size_t length = 0;
+    char *data = malloc(capacity);
+    if (!data)
+        return -1;
+
+    size_t got;
+    while ((got = fread(data + length, 1, capacity - length, file)) > 0)
+    {
+        length += got;
+        if (length == capacity)
+        {
+            capacity *= 2;
+            char *grown = realloc(data, capacity);
+            if (!grown)
+            {
+                free(data);
+                return -1;
+            }
+            data = grown;
+        }
+    }
+
+    if (ferror(file))
+    {
+        free(data);
+        errno = EIO;
+        return -1;
+    }
+
+    src->data = data;
+    src->length = length;
+    src->mapped = false;
+    return 0;
+}
+
+int source_open(const char *path, SourceBuffer *src)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+    {
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                          fd, 0);
+        if (data != MAP_FAILED)
+        {
+            // The lexer makes a single front-to-back pass
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            src->data = data;
+            src->length = (size_t)st.st_size;
+            src->mapped = true;
+            return 0;
+        }
+    }
+
+    // Not mappable: read it the slow way
+    FILE *file = fdopen(fd, "r");
+    if (!file)
+    {
+        close(fd);
+        return -1;
+    }
+    int result = source_read_stream(file, src);
+    fclose(file);
+    return result;
+}
+
+void source_close(SourceBuffer *src)
+{
+    if (!src || !src->data)
+        return;
+
+    if (src->mapped)
+        munmap((void *)src->data, src->length);
+    else
+        free((void *)src->data);
+
+    src->data = NULL;
+    src->length = 0;
+}
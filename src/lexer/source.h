@@ -0,0 +1,29 @@
+#ifndef SOURCE_H
+// "If SOURCE_H is not defined yet..."
+#define SOURCE_H
+// "...define it now."
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Whole source file held in memory. The lexer walks `data` with a raw byte
+// pointer instead of pulling every character through fgetc/ungetc.
+typedef struct
+{
+    const char *data;
+    size_t length;
+    bool mapped; // true: munmap on close, false: free on close
+} SourceBuffer;
+
+// mmap the file at `path`. Falls back to reading it into a heap buffer when
+// the file cannot be mapped (pipes, character devices, empty files).
+// Returns 0 on success, -1 on failure with errno set.
+int source_open(const char *path, SourceBuffer *src);
+
+// Read everything left in an already opened stream into a heap buffer.
+int source_read_stream(FILE *file, SourceBuffer *src);
+
+void source_close(SourceBuffer *src);
+
+#endif // SOURCE_H
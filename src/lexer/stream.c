@@ -0,0 +1,241 @@
+#include "stream.h"
+
+void token_stream_open(TokenStream *ts, const char *data, size_t length,
+                       bool trace)
+{
+    if (length > UINT32_MAX)
+    {
+        fprintf(stderr, "Source too large: offsets are 32-bit\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ts->codes = malloc(TOKEN_WINDOW * sizeof(TokenCode));
+    ts->payloads = malloc(TOKEN_WINDOW * sizeof(uint32_t));
+    ts->offsets = malloc(TOKEN_WINDOW * sizeof(uint32_t));
+    if (!ts->codes || !ts->payloads || !ts->offsets)
+    {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    ts->data = data;
+    ts->length = length;
+    line_index_init(&ts->lines);
+    lexer_init(&ts->lex, data, length, trace);
+    ts->lex.lines = &ts->lines;
+    ts->first = 0;
+    ts->count = 0;
+    ts->exhausted = false;
+    ts->pos = 0;
+    ts->mask = TOKEN_WINDOW - 1;
+    ts->resident = false;
+}
+
+void token_stream_open_resident(TokenStream *ts, const char *data,
+                                size_t length, const TokenCode *codes,
+                                const uint32_t *payloads,
+                                const uint32_t *offsets, size_t count,
+                                const uint32_t *line_starts, size_t num_lines)
+{
+    // Never written to: every token is in, so nothing is ever lexed
+    ts->codes = (TokenCode *)codes;
+    ts->payloads = (uint32_t *)payloads;
+    ts->offsets = (uint32_t *)offsets;
+
+    ts->data = data;
+    ts->length = length;
+    line_index_init(&ts->lines);
+    line_index_assign(&ts->lines, line_starts, num_lines);
+    lexer_init(&ts->lex, data, length, false);
+    ts->lex.lines = &ts->lines;
+    ts->first = 0;
+    ts->count = count;
+    ts->exhausted = true;
+    ts->pos = 0;
+    ts->mask = SIZE_MAX;
+    ts->resident = true;
+}
+
+void token_stream_close(TokenStream *ts)
+{
+    if (!ts->resident)
+    {
+        free(ts->codes);
+        free(ts->payloads);
+        free(ts->offsets);
+    }
+    line_index_free(&ts->lines);
+    ts->codes = NULL;
+    ts->payloads = NULL;
+    ts->offsets = NULL;
+    ts->count = 0;
+}
+
+TokenCode token_code(const Token *token)
+{
+    switch (token->type)
+    {
+    case INT:
+        return TC_INT;
+    case IDENTIFIER:
+        return TC_IDENTIFIER;
+    case STRING_LITERAL:
+        return TC_STRING_LITERAL;
+    case KEYWORD:
+        return (TokenCode)(TC_KEYWORD + token->kind.kw);
+    case SEPARATOR:
+        return (TokenCode)(TC_SEPARATOR + token->kind.sep);
+    default:
+        return (TokenCode)(TC_OPERATOR + token->kind.op);
+    }
+}
+
+// Offset of a token, or of the end of input past the last one
+static uint32_t offset_of(TokenStream *ts, size_t index)
+{
+    if (ts_end(ts, index))
+        return (uint32_t)ts->length;
+    return ts->offsets[index & ts->mask];
+}
+
+// Lex one more token into the window, evicting the oldest when full
+static bool lex_one(TokenStream *ts)
+{
+    Token token;
+
+    if (!lexer_next(&ts->lex, &token))
+    {
+        ts->exhausted = true;
+        return false;
+    }
+
+    if (ts->count == TOKEN_WINDOW)
+    {
+        ts->first++;
+        ts->count--;
+    }
+
+    size_t slot = (ts->first + ts->count) & ts->mask;
+    ts->codes[slot] = token_code(&token);
+    ts->payloads[slot] = token_payload(&token);
+    ts->offsets[slot] = token.offset;
+    ts->count++;
+    return true;
+}
+
+bool ts_fetch(TokenStream *ts, size_t index)
+{
+    if (index < ts->first)
+    {
+        fprintf(stderr, "Token %zu has left the window\n", index);
+        exit(EXIT_FAILURE);
+    }
+
+    while (index >= ts->first + ts->count)
+    {
+        if (ts->exhausted || !lex_one(ts))
+            return false;
+    }
+    return true;
+}
+
+int ts_line(TokenStream *ts, size_t index)
+{
+    int line, col;
+    line_index_locate(&ts->lines, offset_of(ts, index), &line, &col);
+    return line;
+}
+
+int ts_col(TokenStream *ts, size_t index)
+{
+    int line, col;
+    line_index_locate(&ts->lines, offset_of(ts, index), &line, &col);
+    return col;
+}
+
+const char *ts_text(TokenStream *ts, size_t index)
+{
+    TokenCode code = ts_code(ts, index);
+    if (code == TC_EOF)
+        return "end of input";
+    if (code == TC_INT)
+        return NULL;
+    return atom_str(ts->payloads[index & ts->mask]);
+}
+
+Token ts_token(TokenStream *ts, size_t index)
+{
+    Token token;
+
+    if (ts_end(ts, index))
+    {
+        token.type = SEPARATOR;
+        token.atom = ATOM_NONE;
+        token.value.str_val = "end of input";
+        token.offset = (uint32_t)ts->length;
+        token.length = 0;
+        token.kind.sep = SEP_NONE;
+        line_index_locate(&ts->lines, token.offset, &token.line, &token.col);
+        return token;
+    }
+
+    size_t slot = index & ts->mask;
+    TokenCode code = ts->codes[slot];
+    uint32_t payload = ts->payloads[slot];
+
+    token.offset = ts->offsets[slot];
+    line_index_locate(&ts->lines, token.offset, &token.line, &token.col);
+
+    if (code == TC_INT)
+    {
+        token.type = INT;
+        token.atom = ATOM_NONE;
+        token.value.int_val = (int)payload;
+        token.length = (uint32_t)number_literal_length(ts->data + token.offset,
+                                                       ts->data + ts->length);
+        token.kind.op = OP_NONE;
+        return token;
+    }
+
+    // The atom spells exactly the source slice
+    token.atom = payload;
+    token.value.str_val = atom_str(payload);
+    token.length = (uint32_t)atom_len(payload);
+    if (code >= TC_OPERATOR)
+    {
+        token.type = OPERATOR;
+        token.kind.op = (OpKind)(code - TC_OPERATOR);
+    }
+    else if (code >= TC_SEPARATOR)
+    {
+        token.type = SEPARATOR;
+        token.kind.sep = (SepKind)(code - TC_SEPARATOR);
+    }
+    else if (code >= TC_KEYWORD)
+    {
+        token.type = KEYWORD;
+        token.kind.kw = (KeywordKind)(code - TC_KEYWORD);
+    }
+    else
+    {
+        token.type = code == TC_IDENTIFIER ? IDENTIFIER : STRING_LITERAL;
+        token.kind.op = OP_NONE;
+    }
+    return token;
+}
+
+bool next_token(TokenStream *ts, Token *token)
+{
+    if (!peek_token(ts, 0, token))
+        return false;
+    ts->pos++;
+    return true;
+}
+
+bool peek_token(TokenStream *ts, size_t k, Token *token)
+{
+    if (ts_end(ts, ts->pos + k))
+        return false;
+    *token = ts_token(ts, ts->pos + k);
+    return true;
+}
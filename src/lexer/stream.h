@@ -0,0 +1,124 @@
+#ifndef STREAM_H
+// "If STREAM_H is not defined yet..."
+#define STREAM_H
+// "...define it now."
+
+#include "lexer.h"
+
+// Tokens held in memory at once; must be a power of two
+#ifndef TOKEN_WINDOW
+#define TOKEN_WINDOW 1024
+#endif
+
+// Token type and sub-kind packed into one byte
+typedef uint8_t TokenCode;
+enum
+{
+    TC_EOF,
+    TC_INT,
+    TC_IDENTIFIER,
+    TC_STRING_LITERAL,
+    TC_KEYWORD,                             // + KeywordKind
+    TC_SEPARATOR = TC_KEYWORD + KW_COUNT,   // + SepKind
+    TC_OPERATOR = TC_SEPARATOR + SEP_COUNT, // + OpKind
+    TC_COUNT = TC_OPERATOR + OP_COUNT
+};
+
+TokenCode token_code(const Token *token);
+
+// What the stream keeps of a token besides its code and offset
+static inline uint32_t token_payload(const Token *token)
+{
+    return token->type == INT ? (uint32_t)token->value.int_val : token->atom;
+}
+
+// Pull-based token source. Tokens are lexed on demand into a ring of the
+// last TOKEN_WINDOW tokens, stored as parallel arrays: a 1-byte code, a
+// 4-byte payload (int value or atom) and a 4-byte source offset. Line and
+// column are worked out from the offset only when asked for, by a binary
+// search in the line starts the lexer records as it goes.
+//
+// The parser reads forward only, so a token never has to come back once
+// it has left the window. Token memory stays the same however long the
+// source is; the line index costs four bytes per line.
+typedef struct
+{
+    const char *data;
+    size_t length;
+    TokenCode *codes;
+    uint32_t *payloads;
+    uint32_t *offsets;
+    size_t first;   // index of the oldest token held
+    size_t count;   // tokens held: [first, first + count)
+    bool exhausted; // lexer reached the end of input
+    LexState lex;   // where lexing continues after the newest token
+    size_t pos;      // cursor for next_token/peek_token
+    LineIndex lines; // filled in by the lexer as it first passes each line
+    size_t mask;     // token index -> array slot
+    bool resident;   // the arrays hold every token and belong to the caller
+} TokenStream;
+
+void token_stream_open(TokenStream *ts, const char *data, size_t length,
+                       bool trace);
+// A stream over tokens that were lexed already (see TokenCache); the
+// arrays must outlive it
+void token_stream_open_resident(TokenStream *ts, const char *data,
+                                size_t length, const TokenCode *codes,
+                                const uint32_t *payloads,
+                                const uint32_t *offsets, size_t count,
+                                const uint32_t *line_starts, size_t num_lines);
+void token_stream_close(TokenStream *ts);
+
+// Make `index` resident, lexing forward as needed; false when `index` is
+// past the last token
+bool ts_fetch(TokenStream *ts, size_t index);
+
+static inline bool ts_end(TokenStream *ts, size_t index)
+{
+    // Unsigned wrap makes indices below the window fail the first test
+    return !(index - ts->first < ts->count || ts_fetch(ts, index));
+}
+
+// TC_EOF past the last token
+static inline TokenCode ts_code(TokenStream *ts, size_t index)
+{
+    if (ts_end(ts, index))
+        return TC_EOF;
+    return ts->codes[index & ts->mask];
+}
+
+static inline TokenType ts_type(TokenStream *ts, size_t index)
+{
+    TokenCode code = ts_code(ts, index);
+    if (code == TC_INT)
+        return INT;
+    if (code == TC_IDENTIFIER)
+        return IDENTIFIER;
+    if (code == TC_STRING_LITERAL)
+        return STRING_LITERAL;
+    if (code >= TC_KEYWORD && code < TC_SEPARATOR)
+        return KEYWORD;
+    if (code >= TC_OPERATOR)
+        return OPERATOR;
+    return SEPARATOR; // separators and end of input
+}
+
+// OP_NONE unless the token is an operator
+static inline OpKind ts_op(TokenStream *ts, size_t index)
+{
+    TokenCode code = ts_code(ts, index);
+    return code >= TC_OPERATOR ? (OpKind)(code - TC_OPERATOR) : OP_NONE;
+}
+
+int ts_line(TokenStream *ts, size_t index);
+int ts_col(TokenStream *ts, size_t index);
+// Source text of the token; NULL for numbers
+const char *ts_text(TokenStream *ts, size_t index);
+// Unpack into a full Token (with line/col) for node creation and printing
+Token ts_token(TokenStream *ts, size_t index);
+
+// Sequential access from the stream's own cursor; false at end of input
+bool next_token(TokenStream *ts, Token *token);
+bool peek_token(TokenStream *ts, size_t k, Token *token);
+
+#endif // STREAM_H
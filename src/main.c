@@ -1,8 +1,21 @@
 #include <stdio.h>
 #include "lexer/lexer.h"
+#include "lexer/cache.h"
 #include "parser/parser.h"
+#include "parser/ast.h"
 #include "codegen/codegen.h"
 
+// Stream the source's tokens: from the token cache when there is one,
+// otherwise by lexing on demand
+static void open_stream(TokenStream *stream, const SourceBuffer *source,
+                        const TokenCache *cache)
+{
+    if (cache)
+        token_cache_stream(cache, stream, source->data, source->length);
+    else
+        token_stream_open(stream, source->data, source->length, false);
+}
+
 int main(int argc, char *argv[])
 {
     if (argc < 2)
@@ -11,15 +24,42 @@ int main(int argc, char *argv[])
         return 1;
     }
 
-    FILE *file = fopen(argv[1], "r");
-    if (!file)
+    // Map the whole source; the lexer walks it with a byte pointer
+    SourceBuffer source;
+    if (source_open(argv[1], &source) != 0)
     {
         perror("Failed to open file");
         return 1;
     }
 
-    size_t num_tokens = 0;
-    Token *tokens = lexer(file, &num_tokens);
+    // Tokens are pulled through a fixed-size window (see TokenStream), so
+    // no pass below holds the whole token list; each one re-lexes instead
+    TokenStream stream;
+    Token token;
+
+    // With TOYCC_TOKEN_CACHE=<dir>, the tokens are kept on disk instead,
+    // and compiling the same source again skips the lexer
+    const char *cache_dir = getenv("TOYCC_TOKEN_CACHE");
+    TokenCache token_cache;
+    TokenCache *cache = NULL;
+
+    if (cache_dir && *cache_dir)
+    {
+        token_cache_open(&token_cache, cache_dir, source.data, source.length);
+        cache = &token_cache;
+    }
+
+#if LEXER_TRACE
+    // Lexer debug trace, printed before the listing as it always was. A
+    // cache hit has nothing to show: the lexer does not run at all.
+    if (!cache || !cache->hit)
+    {
+        token_stream_open(&stream, source.data, source.length, true);
+        while (next_token(&stream, &token))
+            ;
+        token_stream_close(&stream);
+    }
+#endif
 
     // // Cleanup heap-allocated strings
     // for (size_t i = 0; i < num_tokens; ++i)
@@ -35,16 +75,25 @@ int main(int argc, char *argv[])
 
     // Print all tokens collected
     printf("\n--- All Tokens ---\n");
-    for (size_t i = 0; i < num_tokens; ++i)
+    open_stream(&stream, &source, cache);
+    while (next_token(&stream, &token))
     {
-        print_token(tokens[i]);
+        print_token(token);
     }
+    token_stream_close(&stream);
 
-    Node *root = parse(tokens, num_tokens);
+    open_stream(&stream, &source, cache);
+    Node *root = parse(&stream);
+
+    // The later passes walk a compact copy of the tree; the parser's nodes
+    // can go straight away
+    Ast ast;
+    ast_from_tree(&ast, root);
+    free_ast(root);
 
     printf("\n--- Syntax Tree ---\n");
     // left child right sibling
-    treeTraversal(root, 0);
+    treeTraversal(&ast, ast.root, 0);
 
     // Default output name if not provided
     char *output_name = (argc >= 3) ? argv[2] : "generated";
@@ -52,7 +101,7 @@ int main(int argc, char *argv[])
     // Code Generation
     char asm_filename[256];
     snprintf(asm_filename, sizeof(asm_filename), "%s.asm", output_name);
-    generate_code(root, asm_filename);
+    generate_code(&ast, asm_filename);
 
     // Compilation Pipeline
     char nasm_cmd[256];
@@ -80,9 +129,12 @@ int main(int argc, char *argv[])
 
 cleanup:
     // Resource cleanup
-    free_ast(root);
+    ast_free(&ast);
     printf("\nExiting\n");
-    free_tokens(tokens, num_tokens);
-    fclose(file);
+    token_stream_close(&stream);
+    if (cache)
+        token_cache_close(cache);
+    intern_free_all();
+    source_close(&source);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef ARITH_H
+// "If ARITH_H is not defined yet..."
+#define ARITH_H
+// "...define it now."
+
+#include <stdint.h>
+
+// The language's int arithmetic, shared by the evaluator, the loop VM and
+// the closed forms so they agree on every input. Sums, differences and
+// products wrap at 32 bits; a shift uses only the low five bits of its
+// count, as x86 does; INT_MIN / -1 wraps to INT_MIN, and INT_MIN % -1 is
+// 0. Division by zero is left to the caller.
+
+static inline int arith_add(int x, int y)
+{
+    return (int)((uint32_t)x + (uint32_t)y);
+}
+
+static inline int arith_sub(int x, int y)
+{
+    return (int)((uint32_t)x - (uint32_t)y);
+}
+
+static inline int arith_mul(int x, int y)
+{
+    return (int)((uint32_t)x * (uint32_t)y);
+}
+
+static inline int arith_shl(int x, int y)
+{
+    return (int)((uint32_t)x << (y & 31));
+}
+
+// Arithmetic: the sign bit is copied in
+static inline int arith_shr(int x, int y)
+{
+    return x >> (y & 31);
+}
+
+static inline int arith_div(int x, int y)
+{
+    return y == -1 ? arith_sub(0, x) : x / y;
+}
+
+static inline int arith_mod(int x, int y)
+{
+    return y == -1 ? 0 : x % y;
+}
+
+#endif // ARITH_H
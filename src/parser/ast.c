@@ -0,0 +1,276 @@
+#include <stdlib.h>
+#include "ast.h"
+
+#define INITIAL_AST_CAPACITY 256
+#define INITIAL_PENDING_CAPACITY 64
+
+// A Node still to be copied, and which field of the copied node `parent`
+// must point at it (parent is AST_NONE for the root)
+typedef struct
+{
+    const Node *node;
+    NodeIndex parent;
+    bool is_child; // parent's `left` rather than its `right`
+} PendingNode;
+
+static void ast_out_of_memory(void)
+{
+    fprintf(stderr, "Memory allocation failed in AST\n");
+    exit(EXIT_FAILURE);
+}
+
+static void *grow(void *array, size_t *capacity, size_t element_size)
+{
+    *capacity *= 2;
+    array = realloc(array, *capacity * element_size);
+    if (!array)
+        ast_out_of_memory();
+    return array;
+}
+
+void ast_from_tree(Ast *ast, const Node *root)
+{
+    size_t capacity = INITIAL_AST_CAPACITY;
+    size_t pending_capacity = INITIAL_PENDING_CAPACITY;
+    ast->nodes = malloc(capacity * sizeof(AstNode));
+    PendingNode *pending = malloc(pending_capacity * sizeof(PendingNode));
+    if (!ast->nodes || !pending)
+        ast_out_of_memory();
+
+    memset(&ast->nodes[AST_NONE], 0, sizeof(AstNode));
+    ast->count = 1;
+    ast->root = AST_NONE;
+
+    size_t num_pending = 0;
+    if (root)
+        pending[num_pending++] = (PendingNode){root, AST_NONE, false};
+
+    // Depth-first with an explicit stack, so deep trees cannot overflow the
+    // C stack. The sibling is pushed before the child, which puts the
+    // child's subtree first in the array.
+    while (num_pending > 0)
+    {
+        PendingNode next = pending[--num_pending];
+        const Node *node = next.node;
+
+        if (ast->count >= capacity)
+            ast->nodes = grow(ast->nodes, &capacity, sizeof(AstNode));
+        if (ast->count > UINT32_MAX)
+            ast_out_of_memory();
+        NodeIndex index = (NodeIndex)ast->count++;
+
+        AstNode *out = &ast->nodes[index];
+        out->type = (uint8_t)node->type;
+        out->op = (uint8_t)node->op;
+        if (node->type == NODE_LITERAL_INT)
+            out->value.int_val = node->value.int_val;
+        else
+            out->value.atom = node->atom;
+        out->left = AST_NONE;
+        out->right = AST_NONE;
+        out->line = node->line;
+        out->col = node->col;
+
+        if (next.parent == AST_NONE)
+            ast->root = index;
+        else if (next.is_child)
+            ast->nodes[next.parent].left = index;
+        else
+            ast->nodes[next.parent].right = index;
+
+        if (num_pending + 2 > pending_capacity)
+            pending = grow(pending, &pending_capacity, sizeof(PendingNode));
+        if (node->right)
+            pending[num_pending++] = (PendingNode){node->right, index, false};
+        if (node->left)
+            pending[num_pending++] = (PendingNode){node->left, index, true};
+    }
+
+    free(pending);
+}
+
+// Tree Traversal
+// What is left to print, kept on an explicit stack so that neither long
+// sibling lists nor deep nesting use the C stack
+typedef enum
+{
+    PRINT_LIST,      // `index` and its siblings
+    PRINT_CONDITION, // the "CONDITION:" header of a do-while
+    PRINT_BLOCK_END
+} PrintAction;
+
+typedef struct
+{
+    PrintAction action;
+    NodeIndex index;
+    int depth;
+} PrintItem;
+
+typedef struct
+{
+    PrintItem *items;
+    size_t count;
+    size_t capacity;
+} PrintStack;
+
+static void push_print(PrintStack *stack, PrintAction action,
+                       NodeIndex index, int depth)
+{
+    if (stack->count >= stack->capacity)
+        stack->items = grow(stack->items, &stack->capacity,
+                            sizeof(PrintItem));
+    stack->items[stack->count++] = (PrintItem){action, index, depth};
+}
+
+static void print_indent(int depth)
+{
+    for (int i = 0; i < depth; i++)
+        printf("  ");
+}
+
+void treeTraversal(const Ast *ast, NodeIndex index, int depth)
+{
+    PrintStack stack = {NULL, 0, INITIAL_PENDING_CAPACITY};
+    stack.items = malloc(stack.capacity * sizeof(PrintItem));
+    if (!stack.items)
+        ast_out_of_memory();
+    push_print(&stack, PRINT_LIST, index, depth);
+
+    // Pushes happen in reverse: whatever is printed first goes on last
+    while (stack.count > 0)
+    {
+        PrintItem item = stack.items[--stack.count];
+        depth = item.depth;
+
+        if (item.action == PRINT_CONDITION)
+        {
+            print_indent(depth);
+            printf("CONDITION:\n");
+            continue;
+        }
+        if (item.action == PRINT_BLOCK_END)
+        {
+            print_indent(depth);
+            printf("} // END BLOCK\n");
+            continue;
+        }
+        if (item.index == AST_NONE)
+            continue;
+
+        const AstNode *node = ast_node(ast, item.index);
+
+        // The rest of the list comes after this node and its children. A
+        // binary expression ends its list: its `right` is an operand.
+        if (node->type != NODE_BINARY_EXPR)
+            push_print(&stack, PRINT_LIST, node->right, depth);
+
+        print_indent(depth);
+
+        switch (node->type)
+        {
+        case NODE_BEGIN:
+            printf("PROGRAM\n");
+            push_print(&stack, PRINT_LIST, node->left, depth + 1);
+            break;
+
+        case NODE_VAR_DECL:
+            printf("VAR_DECL: %s\n",
+                   ast_str(node) ? ast_str(node) : "(null)");
+            push_print(&stack, PRINT_LIST, node->left, depth + 1);
+            break;
+
+        case NODE_ASSIGNMENT:
+            printf("ASSIGNMENT: %s\n",
+                   ast_str(node) ? ast_str(node) : "(null)");
+            push_print(&stack, PRINT_LIST, node->left, depth + 1);
+            break;
+
+        case NODE_BINARY_EXPR:
+            printf("BINARY_EXPR: %s\n",
+                   ast_str(node) ? ast_str(node) : "(null)");
+            // Both operands, each with its own siblings, but not the
+            // operator's siblings
+            push_print(&stack, PRINT_LIST, node->right, depth + 1);
+            push_print(&stack, PRINT_LIST, node->left, depth + 1);
+            break;
+
+        case NODE_EXIT_CALL:
+            printf("EXIT_CALL\n");
+            push_print(&stack, PRINT_LIST, node->left, depth + 1);
+            break;
+
+        case NODE_IF_STATEMENT:
+            printf("IF_STATEMENT\n");
+
+            print_indent(depth + 1);
+            printf("CONDITION:\n");
+            push_print(&stack, PRINT_LIST, node->left, depth + 2);
+            break;
+
+        case NODE_ELSE_IF_STATEMENT:
+            printf("ELSE_IF_STATEMENT\n");
+
+            print_indent(depth + 1);
+            printf("CONDITION:\n");
+            push_print(&stack, PRINT_LIST, node->left, depth + 2);
+            break;
+
+        case NODE_ELSE_STATEMENT:
+            printf("ELSE_STATEMENT\n");
+            push_print(&stack, PRINT_LIST, node->left, depth + 2);
+            break;
+
+        case NODE_WHILE_STATEMENT:
+            printf("WHILE_STATEMENT\n");
+
+            print_indent(depth + 1);
+            printf("CONDITION:\n");
+            push_print(&stack, PRINT_LIST, node->left, depth + 2);
+            break;
+
+        case NODE_DO_WHILE_STATEMENT:
+            printf("DO_WHILE_STATEMENT\n");
+
+            // The block (and everything after it), then the condition on
+            // its own under a header
+            if (node->left && ast_node(ast, node->left)->right)
+            {
+                push_print(&stack, PRINT_LIST,
+                           ast_node(ast, node->left)->right, depth + 2);
+                push_print(&stack, PRINT_CONDITION, AST_NONE, depth + 1);
+            }
+            push_print(&stack, PRINT_LIST, node->left, depth + 2);
+            break;
+
+        case NODE_BLOCK:
+            printf("BLOCK {\n");
+            push_print(&stack, PRINT_BLOCK_END, AST_NONE, depth);
+            push_print(&stack, PRINT_LIST, node->left, depth + 1);
+            break;
+
+        case NODE_IDENTIFIER:
+            printf("IDENTIFIER: %s\n",
+                   ast_str(node) ? ast_str(node) : "(null)");
+            break;
+
+        case NODE_LITERAL_INT:
+            printf("LITERAL_INT: %d\n", node->value.int_val);
+            break;
+
+        default:
+            printf("[UNKNOWN NODE TYPE %d]\n", node->type);
+            push_print(&stack, PRINT_LIST, node->left, depth + 1);
+            break;
+        }
+    }
+
+    free(stack.items);
+}
+
+void ast_free(Ast *ast)
+{
+    free(ast->nodes);
+    ast->nodes = NULL;
+    ast->count = 0;
+    ast->root = AST_NONE;
+}
@@ -0,0 +1,60 @@
+#ifndef AST_H
+// "If AST_H is not defined yet..."
+#define AST_H
+// "...define it now."
+
+#include "parser.h"
+
+// Position of a node in Ast.nodes; AST_NONE (slot 0, never used) is "no node"
+typedef uint32_t NodeIndex;
+
+#define AST_NONE ((NodeIndex)0)
+
+// A Node in 24 bytes instead of 48: 1-byte type and operator, the int
+// value or atom inline, and 32-bit indices in place of the child and
+// sibling pointers. The shape is the parser's left-child/right-sibling one.
+typedef struct
+{
+    uint8_t type; // NodeType
+    uint8_t op;   // OpKind of NODE_BINARY_EXPR / NODE_ASSIGNMENT
+    union
+    {
+        int int_val; // NODE_LITERAL_INT
+        Atom atom;   // everything else: interned text
+    } value;
+    NodeIndex left;  // First child
+    NodeIndex right; // Next sibling
+    int line;
+    int col;
+} AstNode;
+
+// The whole tree in one array, in pre-order: a node is followed by its
+// first child's subtree, then by its next sibling. Walking it front to back
+// is walking the tree, with no pointer chasing between scattered nodes.
+typedef struct
+{
+    AstNode *nodes; // nodes[0] unused
+    size_t count;   // including the unused slot
+    NodeIndex root;
+} Ast;
+
+// Copy the tree returned by parse() into `ast`; the Node tree may be freed
+// (free_ast) right afterwards. A NULL root gives an empty Ast.
+void ast_from_tree(Ast *ast, const Node *root);
+void ast_free(Ast *ast);
+
+// Print the tree from `index` (left child right sibling)
+void treeTraversal(const Ast *ast, NodeIndex index, int depth);
+
+static inline const AstNode *ast_node(const Ast *ast, NodeIndex index)
+{
+    return &ast->nodes[index];
+}
+
+// Text of a node that carries an atom
+static inline const char *ast_str(const AstNode *node)
+{
+    return atom_str(node->value.atom);
+}
+
+#endif // AST_H
@@ -2,14 +2,61 @@
 #include <string.h>
 #include <ctype.h>
 #include "parser.h"
+#include "arith.h"
+#include "../arena/arena.h"
+#include "../vm/vm.h"
+#include "../vm/affine.h" // and induction.h
 
 // Forward declarations
-static Node *parse_expression(Token *tokens, size_t *i, size_t num_tokens,
-                              ScopeStack *scope_stack, int min_precedence);
-static Node *parse_primary(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_expression(TokenStream *ts, size_t *i,
+                              ScopeStack *scope_stack, int min_power);
+static Node *parse_primary(TokenStream *ts, size_t *i,
                            ScopeStack *scope_stack);
-static Node *parse_block(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_block(TokenStream *ts, size_t *i,
                          ScopeStack *scope_stack, bool condition_active);
+static Node *evaluate_loop(TokenStream *ts, const Node *loop,
+                           ScopeStack *scope_stack, bool build);
+
+// Token checks read the packed code byte only
+static inline bool is_separator(TokenStream *ts, size_t index, SepKind sep)
+{
+    return ts_code(ts, index) == TC_SEPARATOR + sep;
+}
+
+static inline bool is_keyword(TokenStream *ts, size_t index, KeywordKind kw)
+{
+    return ts_code(ts, index) == TC_KEYWORD + kw;
+}
+
+static inline bool is_operator(TokenStream *ts, size_t index, OpKind op)
+{
+    return ts_code(ts, index) == TC_OPERATOR + op;
+}
+
+// Binary operator applied by each assignment operator; OP_NONE marks
+// operators that do not assign
+static const OpKind assignment_base_op[OP_COUNT] = {
+    [OP_ASSIGN] = OP_ASSIGN,
+    [OP_ADD_ASSIGN] = OP_ADD,
+    [OP_SUB_ASSIGN] = OP_SUB,
+    [OP_MUL_ASSIGN] = OP_MUL,
+    [OP_DIV_ASSIGN] = OP_DIV,
+    [OP_MOD_ASSIGN] = OP_MOD,
+    [OP_SHL_ASSIGN] = OP_SHL,
+    [OP_SHR_ASSIGN] = OP_SHR,
+};
+
+static inline bool is_assignment_op(OpKind op)
+{
+    return op < OP_COUNT && assignment_base_op[op] != OP_NONE;
+}
+
+static const NodeType keyword_node_type[KW_COUNT] = {
+    [KW_NONE] = NODE_UNKNOWN,
+#define X(name, text, node) [KW_##name] = node,
+    KEYWORD_LIST(X)
+#undef X
+};
 
 void debugPrintNode(const char *prefix, Node *node)
 {
@@ -42,173 +89,157 @@ void debugPrintNode(const char *prefix, Node *node)
     }
 }
 
-static SymbolTable *create_symbol_table()
+static ScopeStack *create_scope_stack()
 {
-    SymbolTable *table = malloc(sizeof(SymbolTable));
-    if (!table)
+    ScopeStack *stack = calloc(1, sizeof(ScopeStack));
+    if (!stack)
         return NULL;
-    table->symbols = malloc(sizeof(Symbol) * 16);
-    if (!table->symbols)
-    {
-        free(table);
+    stack->capacity = 64;
+    stack->symbols = malloc(sizeof(Symbol) * stack->capacity);
+    stack->depth_capacity = 8;
+    stack->scope_starts = malloc(sizeof(size_t) * stack->depth_capacity);
+    if (!stack->symbols || !stack->scope_starts)
+    {
+        free(stack->symbols);
+        free(stack->scope_starts);
+        free(stack);
         return NULL;
     }
-    table->size = 0;
-    table->capacity = 16;
-    return table;
+    return stack;
 }
 
-static void free_symbol_table(SymbolTable *table)
+static void free_scope_stack(ScopeStack *stack)
 {
-    if (!table)
+    if (!stack)
         return;
-    for (size_t i = 0; i < table->size; i++)
-    {
-        free(table->symbols[i].name);
-    }
-    free(table->symbols);
-    free(table);
+    // Symbol names are interned, nothing to free per entry
+    free(stack->symbols);
+    free(stack->scope_starts);
+    free(stack->bindings);
+    free(stack);
 }
 
-static void add_symbol(SymbolTable *table, const char *name, VarType type,
-                       int value, int line, int col)
+static void scope_out_of_memory(void)
 {
-    if (!table || !name)
-        return;
+    fprintf(stderr, "Memory allocation failed in scope stack\n");
+    exit(EXIT_FAILURE);
+}
 
-    if (table->size >= table->capacity)
+static void push_scope(ScopeStack *stack)
+{
+    if (stack->depth >= stack->depth_capacity)
     {
-        table->capacity *= 2;
-        Symbol *new_symbols =
-            realloc(table->symbols, sizeof(Symbol) * table->capacity);
-        if (!new_symbols)
-            return;
-        table->symbols = new_symbols;
+        stack->depth_capacity *= 2;
+        size_t *starts = realloc(stack->scope_starts,
+                                 sizeof(size_t) * stack->depth_capacity);
+        if (!starts)
+            scope_out_of_memory();
+        stack->scope_starts = starts;
     }
-
-    table->symbols[table->size].name = strdup(name);
-    if (!table->symbols[table->size].name)
-        return;
-    table->symbols[table->size].type = type;
-    table->symbols[table->size].value = value;
-    table->symbols[table->size].line = line;
-    table->symbols[table->size].col = col;
-    table->size++;
+    stack->scope_starts[stack->depth++] = stack->size;
 }
 
-static void update_symbol(SymbolTable *table, const char *name, int value)
+static void pop_scope(ScopeStack *stack)
 {
-    if (!table || !name)
-        return;
-    for (size_t i = 0; i < table->size; i++)
+    if (stack->depth == 0)
     {
-        if (strcmp(table->symbols[i].name, name) == 0)
-        {
-            table->symbols[i].value = value;
-            return;
-        }
+        printf("Error: Attempt to pop empty scope stack\n");
+        exit(1);
     }
-    printf("Error: Variable '%s' not found for update\n", name);
-    exit(1);
-}
 
-static Symbol *find_symbol(SymbolTable *table, const char *name)
-{
-    if (!table || !name)
-        return NULL;
-    for (size_t i = 0; i < table->size; i++)
+    // Undo the scope's declarations newest first, so each name gets back
+    // the binding it had when the scope was entered
+    size_t start = stack->scope_starts[--stack->depth];
+    while (stack->size > start)
     {
-        if (strcmp(table->symbols[i].name, name) == 0)
-        {
-            return &table->symbols[i];
-        }
+        Symbol *sym = &stack->symbols[--stack->size];
+        stack->bindings[sym->atom] = sym->shadowed;
     }
-    return NULL;
 }
 
-static ScopeStack *create_scope_stack()
+// Innermost visible declaration of `name`: one array lookup
+Symbol *find_symbol_in_scope_stack(ScopeStack *stack, Atom name)
 {
-    ScopeStack *stack = malloc(sizeof(ScopeStack));
-    if (!stack)
-        return NULL;
-    stack->tables = malloc(sizeof(SymbolTable *) * 8);
-    if (!stack->tables)
-    {
-        free(stack);
+    if (!stack || name == ATOM_NONE || name >= stack->num_bindings)
         return NULL;
-    }
-    stack->size = 0;
-    stack->capacity = 8;
-    return stack;
+    uint32_t binding = stack->bindings[name];
+    return binding ? &stack->symbols[binding - 1] : NULL;
 }
 
-static void push_scope(ScopeStack *stack, SymbolTable *table)
+// Declare `name` in the innermost scope. A second declaration in the same
+// scope is ignored: the first one stays the visible one.
+static void add_symbol(ScopeStack *stack, Atom name, VarType type,
+                       int value, int line, int col)
 {
-    if (!stack || !table)
+    if (!stack || name == ATOM_NONE || stack->depth == 0)
         return;
-    if (stack->size >= stack->capacity)
-    {
-        stack->capacity *= 2;
-        SymbolTable **new_tables = realloc(stack->tables,
-                                           sizeof(SymbolTable *) * stack->capacity);
-        if (!new_tables)
-            return;
-        stack->tables = new_tables;
-    }
-    stack->tables[stack->size++] = table;
-}
 
-static SymbolTable *pop_scope(ScopeStack *stack)
-{
-    if (!stack || stack->size == 0)
+    if (name >= stack->num_bindings)
     {
-        printf("Error: Attempt to pop empty scope stack\n");
-        exit(1);
+        // Atoms appear as the lexer meets new names; cover them all
+        size_t count = stack->num_bindings ? stack->num_bindings : 64;
+        while (count <= name)
+            count *= 2;
+        uint32_t *bindings = realloc(stack->bindings,
+                                     sizeof(uint32_t) * count);
+        if (!bindings)
+            scope_out_of_memory();
+        memset(bindings + stack->num_bindings, 0,
+               sizeof(uint32_t) * (count - stack->num_bindings));
+        stack->bindings = bindings;
+        stack->num_bindings = count;
     }
-    return stack->tables[--stack->size];
-}
-
-static SymbolTable *current_scope(ScopeStack *stack)
-{
-    if (!stack || stack->size == 0)
-        return NULL;
-    return stack->tables[stack->size - 1];
-}
 
-static void free_scope_stack(ScopeStack *stack)
-{
-    if (!stack)
+    uint32_t previous = stack->bindings[name];
+    if (previous > stack->scope_starts[stack->depth - 1])
         return;
-    for (size_t i = 0; i < stack->size; i++)
-    {
-        free_symbol_table(stack->tables[i]);
-    }
-    free(stack->tables);
-    free(stack);
-}
 
-static Symbol *find_symbol_in_scope_stack(ScopeStack *stack, const char *name)
-{
-    if (!stack || !name)
-        return NULL;
-    // Search from innermost to outermost scope
-    for (int i = stack->size - 1; i >= 0; i--)
+    if (stack->size >= stack->capacity)
     {
-        Symbol *sym = find_symbol(stack->tables[i], name);
-        if (sym)
-            return sym;
-    }
-    return NULL;
+        stack->capacity *= 2;
+        Symbol *symbols = realloc(stack->symbols,
+                                  sizeof(Symbol) * stack->capacity);
+        if (!symbols)
+            scope_out_of_memory();
+        stack->symbols = symbols;
+    }
+
+    Symbol *sym = &stack->symbols[stack->size];
+    sym->atom = name;
+    sym->name = atom_str(name);
+    sym->type = type;
+    sym->value = value;
+    sym->line = line;
+    sym->col = col;
+    sym->shadowed = previous;
+    stack->bindings[name] = (uint32_t)++stack->size;
 }
 
+// Every node of the AST lives here; free_ast frees them all at once.
+static Arena node_arena;
+
+// While a loop is being read, the parser records its syntax only: names
+// are not looked up, nothing is declared or assigned, and constants are
+// the only thing folded. evaluate_loop then runs that tree, once per
+// iteration or, past the first, as bytecode (see vm_run_loop). Its nodes
+// live in syntax_arena until the outermost loop is done, and each
+// expression is the last child of its statement, so a binary operand is
+// never taken for a sibling:
+//   if / else if / while: block, then condition
+//   x op= e: identifier x, then e (or "x op e"); node->op keeps the op
+static bool syntax_only;
+static Arena syntax_arena;
+
 // Node Creation
-static Node *createNode(NodeType type, const char *value, int line, int col)
+static Node *createNode(NodeType type, Atom value, int line, int col)
 {
-    Node *node = malloc(sizeof(Node));
+    Node *node = arena_alloc(syntax_only ? &syntax_arena : &node_arena,
+                             sizeof(Node));
     if (!node)
         return NULL;
 
     node->type = type;
+    node->op = OP_NONE;
     node->line = line;
     node->col = col;
     node->left = NULL;
@@ -216,18 +247,14 @@ static Node *createNode(NodeType type, const char *value, int line, int col)
 
     if (type == NODE_LITERAL_INT)
     {
-        node->value.int_val = value ? atoi(value) : 0;
+        node->atom = ATOM_NONE;
+        node->value.int_val = value ? atoi(atom_str(value)) : 0;
     }
     else
     {
-        // Only strdup if value is not NULL and we need a copy
-        node->value.str_val = value ? strdup(value) : NULL;
-        if (value && !node->value.str_val)
-        {
-            // strdup failed
-            free(node);
-            return NULL;
-        }
+        // Interned: shared with the tokens, never freed per node
+        node->atom = value;
+        node->value.str_val = atom_str(value);
     }
 
     return node;
@@ -236,39 +263,25 @@ static Node *createNode(NodeType type, const char *value, int line, int col)
 static Node *createNodeFromToken(Token token)
 {
     NodeType type;
-    char *value_str = NULL;
+    Atom value = ATOM_NONE;
 
     switch (token.type)
     {
     case INT:
         type = NODE_LITERAL_INT;
-        value_str = NULL; // We'll use int_val directly
+        value = ATOM_NONE; // We'll use int_val directly
         break;
     case IDENTIFIER:
         type = NODE_IDENTIFIER;
-        value_str = token.value.str_val;
+        value = token.atom;
         break;
     case KEYWORD:
-        if (strcmp(token.value.str_val, "exit") == 0)
-        {
-            type = NODE_EXIT_CALL;
-        }
-        else if (strcmp(token.value.str_val, "if") == 0)
-        {
-            type = NODE_IF_STATEMENT;
-        }
-        else if (strcmp(token.value.str_val, "int") == 0)
-        {
-            type = NODE_TYPE_SPECIFIER;
-        }
-        else
-        {
-            type = NODE_UNKNOWN;
-        }
-        value_str = token.value.str_val;
+        type = token.kind.kw < KW_COUNT ? keyword_node_type[token.kind.kw]
+                                        : NODE_UNKNOWN;
+        value = token.atom;
         break;
     case OPERATOR:
-        if (strcmp(token.value.str_val, "=") == 0)
+        if (token.kind.op == OP_ASSIGN)
         {
             type = NODE_ASSIGNMENT;
         }
@@ -276,10 +289,10 @@ static Node *createNodeFromToken(Token token)
         {
             type = NODE_BINARY_EXPR;
         }
-        value_str = token.value.str_val;
+        value = token.atom;
         break;
     case SEPARATOR:
-        if (strcmp(token.value.str_val, ";") == 0)
+        if (token.kind.sep == SEP_SEMICOLON)
         {
             type = NODE_STATEMENT_END;
         }
@@ -287,15 +300,15 @@ static Node *createNodeFromToken(Token token)
         {
             type = NODE_UNKNOWN;
         }
-        value_str = token.value.str_val;
+        value = token.atom;
         break;
     default:
         type = NODE_UNKNOWN;
-        value_str = NULL;
+        value = ATOM_NONE;
         break;
     }
 
-    Node *node = createNode(type, value_str, token.line, token.col);
+    Node *node = createNode(type, value, token.line, token.col);
     if (!node)
         return NULL;
 
@@ -303,164 +316,148 @@ static Node *createNodeFromToken(Token token)
     {
         node->value.int_val = token.value.int_val;
     }
+    else if (token.type == OPERATOR)
+    {
+        node->op = token.kind.op;
+    }
     return node;
 }
 
 // Expression Evaluation
-static int evaluate_constant_expression(Node *node)
+// Value of `left op right` for two constants, as the program would compute
+// it (see arith.h); division by zero is reported
+static int fold_binary(OpKind op, int left, int right)
 {
-    if (!node)
-        return 0;
-
-    if (node->type == NODE_LITERAL_INT)
-    {
-        return node->value.int_val;
-    }
-
-    if (node->type == NODE_IDENTIFIER)
-    {
-        // Don't fold identifiers to constants
-        fprintf(stderr, "Warning: Cannot evaluate identifier '%s' as constant\n",
-                node->value.str_val ? node->value.str_val : "(null)");
-        // Signal non-constant by exiting or special handling (return a sentinel)
-        // Here we just exit to catch this early
-        exit(1);
-    }
-
-    if (node->type == NODE_BINARY_EXPR)
-    {
-        if (!node->left || !node->right)
-        {
-            fprintf(stderr, "Error: Binary expression missing operands\n");
+    switch (op)
+    {
+    case OP_ADD:
+        return arith_add(left, right);
+    case OP_SUB:
+        return arith_sub(left, right);
+    case OP_MUL:
+        return arith_mul(left, right);
+    case OP_DIV:
+        if (right == 0)
+        {
+            fprintf(stderr, "Error: Division by zero\n");
             exit(1);
         }
-
-        int left = evaluate_constant_expression(node->left);
-        int right = evaluate_constant_expression(node->right);
-
-        const char *op = node->value.str_val;
-        if (!op)
+        return arith_div(left, right);
+    case OP_MOD:
+        if (right == 0)
         {
-            fprintf(stderr, "Error: Binary expression without operator string\n");
+            fprintf(stderr, "Error: Modulo by zero\n");
             exit(1);
         }
-
-        if (strcmp(op, "+") == 0)
-            return left + right;
-        if (strcmp(op, "-") == 0)
-            return left - right;
-        if (strcmp(op, "*") == 0)
-            return left * right;
-        if (strcmp(op, "/") == 0)
-        {
-            if (right == 0)
-            {
-                fprintf(stderr, "Error: Division by zero\n");
-                exit(1);
-            }
-            return left / right;
-        }
-        if (strcmp(op, "%") == 0)
-        {
-            if (right == 0)
-            {
-                fprintf(stderr, "Error: Modulo by zero\n");
-                exit(1);
-            }
-            return left % right;
-        }
-        if (strcmp(op, "&") == 0)
-            return left & right;
-        if (strcmp(op, "|") == 0)
-            return left | right;
-        if (strcmp(op, "^") == 0)
-            return left ^ right;
-        if (strcmp(op, "<<") == 0)
-            return left << right;
-        if (strcmp(op, ">>") == 0)
-            return left >> right;
-        if (strcmp(op, "==") == 0)
-            return left == right;
-        if (strcmp(op, "<") == 0)
-            return left < right;
-        if (strcmp(op, "<=") == 0)
-            return left <= right;
-        if (strcmp(op, ">") == 0)
-            return left > right;
-        if (strcmp(op, ">=") == 0)
-            return left >= right;
-        if (strcmp(op, "!=") == 0)
-            return left != right;
-        if (strcmp(op, "&&") == 0)
-            return left && right;
-        if (strcmp(op, "||") == 0)
-            return left || right;
-
-        fprintf(stderr, "Error: Unknown operator '%s'\n", op);
-        exit(1);
+        return arith_mod(left, right);
+    case OP_BIT_AND:
+        return left & right;
+    case OP_BIT_OR:
+        return left | right;
+    case OP_BIT_XOR:
+        return left ^ right;
+    case OP_SHL:
+        return arith_shl(left, right);
+    case OP_SHR:
+        return arith_shr(left, right);
+    case OP_EQ:
+        return left == right;
+    case OP_LT:
+        return left < right;
+    case OP_LE:
+        return left <= right;
+    case OP_GT:
+        return left > right;
+    case OP_GE:
+        return left >= right;
+    case OP_NE:
+        return left != right;
+    case OP_AND:
+        return left && right;
+    case OP_OR:
+        return left || right;
+    default:
+        break;
     }
 
-    fprintf(stderr, "Error: Cannot evaluate node type %d as constant\n",
-            node->type);
+    fprintf(stderr, "Error: Unknown operator '%s'\n",
+            op < OP_COUNT && op_kind_text(op) ? op_kind_text(op) : "(null)");
     exit(1);
 }
 
-// Operator Precedence
-static int get_precedence(const char *op)
+// Value of `x` after `x op= rhs`. Unlike fold_binary, a zero divisor is
+// not an error: the variable keeps its value.
+static int compound_result(OpKind op, int current_value, int rhs_value)
 {
-    if (!op)
-        return -1;
-
-    if (strcmp(op, "*") == 0 || strcmp(op, "/") == 0 ||
-        strcmp(op, "%") == 0)
-        return 9;
-
-    if (strcmp(op, "+") == 0 || strcmp(op, "-") == 0)
-        return 8;
-
-    if (strcmp(op, "<<") == 0 || strcmp(op, ">>") == 0)
-        return 7;
-
-    if (strcmp(op, "<") == 0 || strcmp(op, "<=") == 0 ||
-        strcmp(op, ">") == 0 || strcmp(op, ">=") == 0)
-        return 6;
-
-    if (strcmp(op, "==") == 0 || strcmp(op, "!=") == 0)
-        return 5;
-
-    if (strcmp(op, "&") == 0)
-        return 4;
-
-    if (strcmp(op, "^") == 0)
-        return 3;
-
-    if (strcmp(op, "|") == 0)
-        return 2;
-
-    if (strcmp(op, "&&") == 0)
-        return 1;
-
-    if (strcmp(op, "||") == 0)
-        return 0;
-
-    // Unknown operator
-    return -1;
+    switch (op)
+    {
+    case OP_ADD:
+        return arith_add(current_value, rhs_value);
+    case OP_SUB:
+        return arith_sub(current_value, rhs_value);
+    case OP_MUL:
+        return arith_mul(current_value, rhs_value);
+    case OP_DIV:
+        return rhs_value != 0 ? arith_div(current_value, rhs_value)
+                              : current_value;
+    case OP_MOD:
+        return rhs_value != 0 ? arith_mod(current_value, rhs_value)
+                              : current_value;
+    case OP_SHL:
+        return arith_shl(current_value, rhs_value);
+    case OP_SHR:
+        return arith_shr(current_value, rhs_value);
+    default:
+        return current_value;
+    }
 }
 
+// Operator Precedence
+// Binding power of each binary operator: higher binds tighter, 0 means the
+// operator cannot continue an expression (unary, assignment, or not an
+// operator at all). Every binary operator groups to the left; assignments
+// are statements here, not expressions.
+typedef struct
+{
+    uint8_t power;
+    bool right_assoc;
+} BindingPower;
+
+static const BindingPower binding_power[OP_COUNT] = {
+    [OP_MUL] = {10, false},
+    [OP_DIV] = {10, false},
+    [OP_MOD] = {10, false},
+    [OP_ADD] = {9, false},
+    [OP_SUB] = {9, false},
+    [OP_SHL] = {8, false},
+    [OP_SHR] = {8, false},
+    [OP_LT] = {7, false},
+    [OP_LE] = {7, false},
+    [OP_GT] = {7, false},
+    [OP_GE] = {7, false},
+    [OP_EQ] = {6, false},
+    [OP_NE] = {6, false},
+    [OP_BIT_AND] = {5, false},
+    [OP_BIT_XOR] = {4, false},
+    [OP_BIT_OR] = {3, false},
+    [OP_AND] = {2, false},
+    [OP_OR] = {1, false},
+};
+
 // Primary Parser
-static Node *parse_primary(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_primary(TokenStream *ts, size_t *i,
                            ScopeStack *scope_stack)
 {
-    if (*i >= num_tokens)
+    if (ts_end(ts, *i))
     {
         printf("Error: Unexpected end of input at line %d\n",
-               tokens[*i - 1].line);
+               ts_line(ts, *i - 1));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    Token token = tokens[*i];
+    Token token = ts_token(ts, *i);
 
     if (token.type == INT || token.type == IDENTIFIER)
     {
@@ -470,53 +467,49 @@ static Node *parse_primary(Token *tokens, size_t *i, size_t num_tokens,
         {
             printf("Error: Failed to create node at line %d\n", token.line);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
 
-        if (token.type == IDENTIFIER)
+        if (token.type == IDENTIFIER && !syntax_only)
         {
             Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                     token.value.str_val);
+                                                     token.atom);
             if (!sym)
             {
                 printf("Error: Undefined variable '%s' at line %d\n",
                        token.value.str_val, token.line);
-                free_ast(node);
                 free_scope_stack(scope_stack);
-                free_tokens(tokens, num_tokens);
+                token_stream_close(ts);
                 exit(1);
             }
             if (sym->type == VAR_INT)
             {
-                Node *constant_node = createNode(NODE_LITERAL_INT, NULL,
+                Node *constant_node = createNode(NODE_LITERAL_INT, ATOM_NONE,
                                                  token.line, token.col);
                 if (!constant_node)
                 {
-                    free_ast(node);
                     free_scope_stack(scope_stack);
-                    free_tokens(tokens, num_tokens);
+                    token_stream_close(ts);
                     exit(1);
                 }
                 constant_node->value.int_val = sym->value;
-                free_ast(node);
                 return constant_node;
             }
         }
         return node;
     }
 
-    if (token.type == SEPARATOR && strcmp(token.value.str_val, "(") == 0)
+    if (is_separator(ts, *i, SEP_LPAREN))
     {
         (*i)++;
-        Node *expr = parse_expression(tokens, i, num_tokens, scope_stack, 0);
+        Node *expr = parse_expression(ts, i, scope_stack, 0);
 
-        if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, ")") != 0)
+        if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_RPAREN))
         {
-            printf("Error: Expected ')' at line %d\n", tokens[*i].line);
-            free_ast(expr); // Free the expression before exiting
+            printf("Error: Expected ')' at line %d\n", ts_line(ts, *i));
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
         (*i)++;
@@ -526,127 +519,104 @@ static Node *parse_primary(Token *tokens, size_t *i, size_t num_tokens,
     printf("Error: Unexpected token '%s' at line %d\n", token.value.str_val,
            token.line);
     free_scope_stack(scope_stack);
-    free_tokens(tokens, num_tokens);
+    token_stream_close(ts);
     exit(1);
 }
 
 // Expression Parser
-Node *parse_expression(Token *tokens, size_t *i, size_t num_tokens,
-                       ScopeStack *scope_stack, int min_precedence)
+// Pratt-style: after each operand, any operator binding tighter than
+// `min_power` takes it as its left operand. Two constant operands are
+// folded on the spot into the left literal, so no node is ever built for
+// an operation done at compile time.
+Node *parse_expression(TokenStream *ts, size_t *i,
+                       ScopeStack *scope_stack, int min_power)
 {
-    Node *left = parse_primary(tokens, i, num_tokens, scope_stack);
+    Node *left = parse_primary(ts, i, scope_stack);
     if (!left)
         return NULL;
 
-    while (*i < num_tokens)
+    for (;;)
     {
-        Token op_token = tokens[*i];
-        if (op_token.type != OPERATOR)
+        // OP_NONE, with power 0, at the end of input too
+        OpKind op = ts_op(ts, *i);
+        BindingPower binding = binding_power[op];
+        if (binding.power <= min_power)
             break;
 
-        const char *op = op_token.value.str_val;
-        int precedence = get_precedence(op);
-        if (precedence < min_precedence)
-            break;
+        Token op_token = ts_token(ts, *i);
 
         (*i)++;
-        Node *right = parse_expression(tokens, i, num_tokens, scope_stack,
-                                       precedence + 1);
+        Node *right = parse_expression(ts, i, scope_stack,
+                                       binding.right_assoc
+                                           ? binding.power - 1
+                                           : binding.power);
         if (!right)
-        {
-            free_ast(left);
             return NULL;
+
+        if (left->type == NODE_LITERAL_INT && right->type == NODE_LITERAL_INT)
+        {
+            // The left literal now stands for the whole operation
+            left->value.int_val = fold_binary(op, left->value.int_val,
+                                              right->value.int_val);
+            left->line = op_token.line;
+            left->col = op_token.col;
+            continue;
         }
 
         Node *binary_expr = createNodeFromToken(op_token);
         if (!binary_expr)
-        {
-            free_ast(left);
-            free_ast(right);
             return NULL;
-        }
         binary_expr->left = left;
         binary_expr->right = right;
-
-        // Fold only if both left and right are literals
-        if (left->type == NODE_LITERAL_INT && right->type == NODE_LITERAL_INT)
-        {
-            int result = evaluate_constant_expression(binary_expr);
-
-            Node *folded = createNode(NODE_LITERAL_INT, NULL,
-                                      op_token.line, op_token.col);
-            if (!folded)
-            {
-                free_ast(binary_expr); // This will free left and right too
-                return NULL;
-            }
-            folded->value.int_val = result;
-
-            // Detach children before freeing to avoid double free
-            binary_expr->left = NULL;
-            binary_expr->right = NULL;
-            free_ast(binary_expr);
-            free_ast(left);
-            free_ast(right);
-
-            left = folded;
-        }
-        else
-        {
-            // Keep binary expression node if folding not possible
-            left = binary_expr;
-        }
+        left = binary_expr;
     }
 
     return left;
 }
 
 // Variable Declaration Parser
-static Node *parse_variable_declaration(Token *tokens, size_t *i,
-                                        size_t num_tokens,
+static Node *parse_variable_declaration(TokenStream *ts, size_t *i,
                                         ScopeStack *scope_stack,
                                         Node **last_decl_out,
                                         bool condition_active)
 {
-    if (*i >= num_tokens || tokens[*i].type != KEYWORD ||
-        strcmp(tokens[*i].value.str_val, "int") != 0)
+    if (ts_end(ts, *i) || !is_keyword(ts, *i, KW_INT))
     {
-        printf("Error: Expected 'int' keyword at line %d\n", tokens[*i].line);
+        printf("Error: Expected 'int' keyword at line %d\n",
+               ts_line(ts, *i));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
 
     Node *first_decl = NULL;
     Node *current_decl = NULL;
-    SymbolTable *current_table = current_scope(scope_stack);
 
-    while (*i < num_tokens)
+    while (!ts_end(ts, *i))
     {
-        if (tokens[*i].type != IDENTIFIER)
+        if (ts_type(ts, *i) != IDENTIFIER)
         {
-            printf("Error: Expected identifier at line %d\n", tokens[*i].line);
-            free_ast(first_decl); // Clean up partial AST
+            printf("Error: Expected identifier at line %d\n",
+                   ts_line(ts, *i));
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
-        Token id_token = tokens[*i];
+        Token id_token = ts_token(ts, *i);
         (*i)++;
 
         Node *init_expr = NULL;
         int initial_value = 0;
 
-        if (*i < num_tokens && strcmp(tokens[*i].value.str_val, "=") == 0)
+        if (!ts_end(ts, *i) && is_operator(ts, *i, OP_ASSIGN))
         {
             (*i)++;
-            init_expr = parse_expression(tokens, i, num_tokens, scope_stack, 0);
+            init_expr = parse_expression(ts, i, scope_stack, 0);
             if (!init_expr)
             {
-                free_ast(first_decl);
                 free_scope_stack(scope_stack);
-                free_tokens(tokens, num_tokens);
+                token_stream_close(ts);
                 exit(1);
             }
 
@@ -657,28 +627,25 @@ static Node *parse_variable_declaration(Token *tokens, size_t *i,
             else if (init_expr->type == NODE_IDENTIFIER)
             {
                 Symbol *sym =
-                    find_symbol_in_scope_stack(scope_stack,
-                                               init_expr->value.str_val);
+                    find_symbol_in_scope_stack(scope_stack, init_expr->atom);
                 if (sym)
                     initial_value = sym->value;
             }
         }
 
         // Only add symbol if the condition is active
-        if (condition_active)
+        if (condition_active && !syntax_only)
         {
-            add_symbol(current_table, id_token.value.str_val, VAR_INT,
+            add_symbol(scope_stack, id_token.atom, VAR_INT,
                        initial_value, id_token.line, id_token.col);
         }
 
-        Node *decl_node = createNode(NODE_VAR_DECL, id_token.value.str_val,
+        Node *decl_node = createNode(NODE_VAR_DECL, id_token.atom,
                                      id_token.line, id_token.col);
         if (!decl_node)
         {
-            free_ast(init_expr);
-            free_ast(first_decl);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
         decl_node->left = init_expr;
@@ -694,30 +661,29 @@ static Node *parse_variable_declaration(Token *tokens, size_t *i,
             current_decl = decl_node;
         }
 
-        if (*i >= num_tokens)
+        if (ts_end(ts, *i))
         {
             printf("Error: Unexpected end of input\n");
-            free_ast(first_decl);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
 
-        if (strcmp(tokens[*i].value.str_val, ";") == 0)
+        if (is_separator(ts, *i, SEP_SEMICOLON))
         {
             (*i)++;
             break;
         }
-        else if (strcmp(tokens[*i].value.str_val, ",") == 0)
+        else if (is_separator(ts, *i, SEP_COMMA))
         {
             (*i)++;
         }
         else
         {
-            printf("Error: Expected ',' or ';' at line %d\n", tokens[*i].line);
-            free_ast(first_decl);
+            printf("Error: Expected ',' or ';' at line %d\n",
+                   ts_line(ts, *i));
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
     }
@@ -728,100 +694,85 @@ static Node *parse_variable_declaration(Token *tokens, size_t *i,
 }
 
 // Assignment Statement Parser
-static Node *parse_assignment_statement(Token *tokens, size_t *i,
-                                        size_t num_tokens,
+static Node *parse_assignment_statement(TokenStream *ts, size_t *i,
                                         ScopeStack *scope_stack,
                                         bool condition_active)
 {
-    int start_line = tokens[*i].line;
-    int start_col = tokens[*i].col;
+    int start_line = ts_line(ts, *i);
+    int start_col = ts_col(ts, *i);
 
-    if (*i >= num_tokens || tokens[*i].type != IDENTIFIER)
+    if (ts_end(ts, *i) || ts_type(ts, *i) != IDENTIFIER)
     {
-        printf("Error: Expected identifier at line %d\n", tokens[*i].line);
+        printf("Error: Expected identifier at line %d\n", ts_line(ts, *i));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
-    Token id_token = tokens[*i];
+    Token id_token = ts_token(ts, *i);
     (*i)++;
 
-    // Find which table contains the variable
-    SymbolTable *target_table = NULL;
-    for (int j = scope_stack->size - 1; j >= 0; j--)
-    {
-        if (find_symbol(scope_stack->tables[j], id_token.value.str_val))
-        {
-            target_table = scope_stack->tables[j];
-            break;
-        }
-    }
-    if (!target_table)
+    // The innermost declaration is the one assigned to. Expressions declare
+    // nothing, so the pointer stays valid while the value is parsed.
+    Symbol *target = syntax_only ? NULL
+                                 : find_symbol_in_scope_stack(scope_stack,
+                                                              id_token.atom);
+    if (!target && !syntax_only)
     {
         printf("Error: Undefined variable '%s' at line %d\n",
                id_token.value.str_val, id_token.line);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    if (*i >= num_tokens || tokens[*i].type != OPERATOR ||
-        (strcmp(tokens[*i].value.str_val, "=") != 0 &&
-         strcmp(tokens[*i].value.str_val, "+=") != 0 &&
-         strcmp(tokens[*i].value.str_val, "-=") != 0 &&
-         strcmp(tokens[*i].value.str_val, "*=") != 0 &&
-         strcmp(tokens[*i].value.str_val, "/=") != 0 &&
-         strcmp(tokens[*i].value.str_val, "%=") != 0 &&
-         strcmp(tokens[*i].value.str_val, "<<=") != 0 &&
-         strcmp(tokens[*i].value.str_val, ">>=") != 0))
+    if (ts_end(ts, *i) || ts_type(ts, *i) != OPERATOR ||
+        !is_assignment_op(ts_op(ts, *i)))
     {
         printf("Error: Expected assignment operator at line %d\n",
-               tokens[*i].line);
+               ts_line(ts, *i));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    Token op_token = tokens[*i];
+    Token op_token = ts_token(ts, *i);
     (*i)++;
 
-    Node *expr = parse_expression(tokens, i, num_tokens, scope_stack, 0);
+    Node *expr = parse_expression(ts, i, scope_stack, 0);
     if (!expr)
     {
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, ";") != 0)
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_SEMICOLON))
     {
-        printf("Error: Expected ';' at line %d\n", tokens[*i - 1].line);
-        free_ast(expr);
+        printf("Error: Expected ';' at line %d\n", ts_line(ts, *i - 1));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
 
     // Create assignment node
-    Node *assign_node = createNode(NODE_ASSIGNMENT, "=", start_line, start_col);
+    Node *assign_node = createNode(NODE_ASSIGNMENT, intern("="),
+                                   start_line, start_col);
     if (!assign_node)
     {
-        free_ast(expr);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
+    assign_node->op = syntax_only ? op_token.kind.op : OP_ASSIGN;
 
     // Create left-hand side identifier node
-    Node *lhs = createNode(NODE_IDENTIFIER, id_token.value.str_val,
+    Node *lhs = createNode(NODE_IDENTIFIER, id_token.atom,
                            id_token.line, id_token.col);
     if (!lhs)
     {
-        free_ast(assign_node);
-        free_ast(expr);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     assign_node->left = lhs;
@@ -829,63 +780,59 @@ static Node *parse_assignment_statement(Token *tokens, size_t *i,
     Node *value_to_store = expr;
 
     // Handle compound assignment operators
-    if (strcmp(op_token.value.str_val, "=") != 0)
+    if (op_token.kind.op != OP_ASSIGN)
     {
-        // Extract the binary operator (remove the '=' at the end)
-        char op[4] = {0};
-        strncpy(op, op_token.value.str_val, strlen(op_token.value.str_val) - 1);
+        // The binary operator behind the compound one ("<<=" -> "<<")
+        OpKind op = assignment_base_op[op_token.kind.op];
 
         // Create a new identifier node for the binary operation
         // (don't reuse lhs)
-        Node *lhs_copy = createNode(NODE_IDENTIFIER, id_token.value.str_val,
+        Node *lhs_copy = createNode(NODE_IDENTIFIER, id_token.atom,
                                     id_token.line, id_token.col);
         if (!lhs_copy)
         {
-            free_ast(assign_node); // This will free lhs too
-            free_ast(expr);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
 
-        Node *bin_op = createNode(NODE_BINARY_EXPR, op,
+        Node *bin_op = createNode(NODE_BINARY_EXPR, intern(op_kind_text(op)),
                                   op_token.line, op_token.col);
         if (!bin_op)
         {
-            free_ast(assign_node);
-            free_ast(lhs_copy);
-            free_ast(expr);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
+        bin_op->op = op;
         bin_op->left = lhs_copy;
         bin_op->right = expr;
         value_to_store = bin_op;
     }
 
+    if (syntax_only)
+    {
+        lhs->right = value_to_store;
+        return assign_node;
+    }
     assign_node->right = value_to_store;
 
     // Only update symbol if the condition is active
-    if (condition_active && target_table)
+    if (condition_active)
     {
-        Symbol *sym = find_symbol(target_table, id_token.value.str_val);
-        int current_value = sym ? sym->value : 0;
+        int current_value = target->value;
 
         if (value_to_store->type == NODE_LITERAL_INT)
         {
-            update_symbol(target_table, id_token.value.str_val,
-                          value_to_store->value.int_val);
+            target->value = value_to_store->value.int_val;
         }
         else if (value_to_store->type == NODE_IDENTIFIER)
         {
             Symbol *src_sym =
-                find_symbol_in_scope_stack(scope_stack,
-                                           value_to_store->value.str_val);
+                find_symbol_in_scope_stack(scope_stack, value_to_store->atom);
             if (src_sym)
             {
-                update_symbol(target_table, id_token.value.str_val,
-                              src_sym->value);
+                target->value = src_sym->value;
             }
         }
         else if (value_to_store->type == NODE_BINARY_EXPR)
@@ -899,35 +846,19 @@ static Node *parse_assignment_statement(Token *tokens, size_t *i,
             else if (expr->type == NODE_IDENTIFIER)
             {
                 Symbol *rhs_sym = find_symbol_in_scope_stack(scope_stack,
-                                                             expr->value.str_val);
+                                                             expr->atom);
                 if (rhs_sym)
                     rhs_value = rhs_sym->value;
             }
 
-            const char *op = value_to_store->value.str_val;
-            int result = current_value;
-
-            if (op && strcmp(op, "+") == 0)
-                result = current_value + rhs_value;
-            else if (op && strcmp(op, "-") == 0)
-                result = current_value - rhs_value;
-            else if (op && strcmp(op, "*") == 0)
-                result = current_value * rhs_value;
-            else if (op && strcmp(op, "/") == 0 && rhs_value != 0)
-                result = current_value / rhs_value;
-            else if (op && strcmp(op, "%") == 0 && rhs_value != 0)
-                result = current_value % rhs_value;
-            else if (op && strcmp(op, "<<") == 0)
-                result = current_value << rhs_value;
-            else if (op && strcmp(op, ">>") == 0)
-                result = current_value >> rhs_value;
-
-            update_symbol(target_table, id_token.value.str_val, result);
+            int result = compound_result(value_to_store->op, current_value,
+                                         rhs_value);
+            target->value = result;
 
             // After evaluating the binary expression for symbol table update,
             // we can optionally fold it into a literal to save memory
             // and simplify the AST
-            Node *literal_result = createNode(NODE_LITERAL_INT, NULL,
+            Node *literal_result = createNode(NODE_LITERAL_INT, ATOM_NONE,
                                               value_to_store->line,
                                               value_to_store->col);
             if (!literal_result)
@@ -938,9 +869,6 @@ static Node *parse_assignment_statement(Token *tokens, size_t *i,
             else
             {
                 literal_result->value.int_val = result;
-
-                // Properly free the binary expression and its children
-                free_ast(value_to_store);
                 assign_node->right = literal_result;
             }
         }
@@ -950,85 +878,75 @@ static Node *parse_assignment_statement(Token *tokens, size_t *i,
 }
 
 // Exit Statement Parser
-static Node *parse_exit_statement(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_exit_statement(TokenStream *ts, size_t *i,
                                   ScopeStack *scope_stack)
 {
-    int start_line = tokens[*i].line;
-    int start_col = tokens[*i].col;
+    int start_line = ts_line(ts, *i);
+    int start_col = ts_col(ts, *i);
 
-    Node *exit_node = createNode(NODE_EXIT_CALL, "exit", start_line, start_col);
+    Node *exit_node = createNode(NODE_EXIT_CALL, intern("exit"),
+                                 start_line, start_col);
     if (!exit_node)
     {
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
 
-    if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, "(") != 0)
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_LPAREN))
     {
         printf("Error: Expected '(' after 'exit' at line %d\n",
-               tokens[*i - 1].line);
-        free_ast(exit_node);
+               ts_line(ts, *i - 1));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
 
-    Node *arg = parse_expression(tokens, i, num_tokens, scope_stack, 0);
+    Node *arg = parse_expression(ts, i, scope_stack, 0);
     if (!arg)
     {
-        free_ast(exit_node);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    if (arg->type == NODE_IDENTIFIER)
+    if (arg->type == NODE_IDENTIFIER && !syntax_only)
     {
-        Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                 arg->value.str_val);
+        Symbol *sym = find_symbol_in_scope_stack(scope_stack, arg->atom);
         if (!sym)
         {
             printf("Error: Undefined variable '%s' at line %d\n",
                    arg->value.str_val, arg->line);
-            free_ast(arg);
-            free_ast(exit_node);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
         if (sym->type != VAR_INT)
         {
             printf("Error: Variable '%s' is not an integer at line %d\n",
                    arg->value.str_val, arg->line);
-            free_ast(arg);
-            free_ast(exit_node);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
     }
 
-    if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, ")") != 0)
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_RPAREN))
     {
-        printf("Error: Expected ')' at line %d\n", tokens[*i - 1].line);
-        free_ast(arg);
-        free_ast(exit_node);
+        printf("Error: Expected ')' at line %d\n", ts_line(ts, *i - 1));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
 
-    if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, ";") != 0)
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_SEMICOLON))
     {
-        printf("Error: Expected ';' at line %d\n", tokens[*i - 1].line);
-        free_ast(arg);
-        free_ast(exit_node);
+        printf("Error: Expected ';' at line %d\n", ts_line(ts, *i - 1));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
@@ -1038,177 +956,54 @@ static Node *parse_exit_statement(Token *tokens, size_t *i, size_t num_tokens,
 }
 
 // AST Freeing
-void free_ast(Node *node)
+void free_ast(Node *root)
 {
-    if (!node)
-        return;
-
-    free_ast(node->left);
-    free_ast(node->right);
-
-    // Only free string if it's not a literal int and string exists
-    if (node->type != NODE_LITERAL_INT && node->value.str_val)
-    {
-        free(node->value.str_val);
-        node->value.str_val = NULL;
-    }
-
-    free(node);
-}
-
-// Tree Traversal
-void treeTraversal(Node *node, int depth)
-{
-    while (node)
-    {
-        for (int i = 0; i < depth; i++)
-            printf("  ");
-
-        switch (node->type)
-        {
-        case NODE_BEGIN:
-            printf("PROGRAM\n");
-            treeTraversal(node->left, depth + 1);
-            break;
-
-        case NODE_VAR_DECL:
-            printf("VAR_DECL: %s\n",
-                   node->value.str_val ? node->value.str_val : "(null)");
-            treeTraversal(node->left, depth + 1);
-            break;
-
-        case NODE_ASSIGNMENT:
-            printf("ASSIGNMENT: %s\n",
-                   node->value.str_val ? node->value.str_val : "(null)");
-            treeTraversal(node->left, depth + 1);
-            break;
-
-        case NODE_BINARY_EXPR:
-            printf("BINARY_EXPR: %s\n",
-                   node->value.str_val ? node->value.str_val : "(null)");
-            treeTraversal(node->left, depth + 1);
-            treeTraversal(node->right, depth + 1);
-            return; // Skip sibling traversal here
-
-        case NODE_EXIT_CALL:
-            printf("EXIT_CALL\n");
-            treeTraversal(node->left, depth + 1);
-            break;
-
-        case NODE_IF_STATEMENT:
-            printf("IF_STATEMENT\n");
-
-            for (int i = 0; i < depth + 1; i++)
-                printf("  ");
-            printf("CONDITION:\n");
-            treeTraversal(node->left, depth + 2);
-            break;
-
-        case NODE_ELSE_IF_STATEMENT:
-            printf("ELSE_IF_STATEMENT\n");
-
-            for (int i = 0; i < depth + 1; i++)
-                printf("  ");
-            printf("CONDITION:\n");
-            treeTraversal(node->left, depth + 2);
-            break;
-
-        case NODE_ELSE_STATEMENT:
-            printf("ELSE_STATEMENT\n");
-            treeTraversal(node->left, depth + 2);
-            break;
-
-        case NODE_WHILE_STATEMENT:
-            printf("WHILE_STATEMENT\n");
-
-            for (int i = 0; i < depth + 1; i++)
-                printf("  ");
-            printf("CONDITION:\n");
-            treeTraversal(node->left, depth + 2);
-            break;
-
-        case NODE_DO_WHILE_STATEMENT:
-            printf("DO_WHILE_STATEMENT\n");
-
-            // for (int i = 0; i < depth + 1; i++)
-            //     printf("  ");
-            // printf("BLOCK:\n");
-            treeTraversal(node->left, depth + 2);
-
-            if (node->left && node->left->right)
-            {
-                for (int i = 0; i < depth + 1; i++)
-                    printf("  ");
-                printf("CONDITION:\n");
-                treeTraversal(node->left->right, depth + 2);
-            }
-            break;
-
-        case NODE_BLOCK:
-            printf("BLOCK {\n");
-            treeTraversal(node->left, depth + 1);
-            for (int i = 0; i < depth; i++)
-                printf("  ");
-            printf("} // END BLOCK\n");
-            break;
-
-        case NODE_IDENTIFIER:
-            printf("IDENTIFIER: %s\n",
-                   node->value.str_val ? node->value.str_val : "(null)");
-            break;
-
-        case NODE_LITERAL_INT:
-            printf("LITERAL_INT: %d\n", node->value.int_val);
-            break;
-
-        default:
-            printf("[UNKNOWN NODE TYPE %d]\n", node->type);
-            treeTraversal(node->left, depth + 1);
-            break;
-        }
-
-        node = node->right;
-    }
+    // Every node came from the arena, so the whole tree goes in one step;
+    // strings are interned and shared, not owned by nodes
+    (void)root;
+    arena_destroy(&node_arena);
+    arena_destroy(&syntax_arena);
 }
 
-static Node *parse_if_statement(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_if_statement(TokenStream *ts, size_t *i,
                                 ScopeStack *scope_stack, Node **last_node_out)
 {
-    int start_line = tokens[*i].line;
-    int start_col = tokens[*i].col;
+    int start_line = ts_line(ts, *i);
+    int start_col = ts_col(ts, *i);
 
     // Consume 'if' keyword
     (*i)++;
 
     // Check for opening parenthesis
-    if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, "(") != 0)
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_LPAREN))
     {
-        printf("Error: Expected '(' after 'if' at line %d\n", tokens[*i].line);
+        printf("Error: Expected '(' after 'if' at line %d\n",
+               ts_line(ts, *i));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
 
     // Parse condition
-    Node *condition = parse_expression(tokens, i, num_tokens, scope_stack, 0);
+    Node *condition = parse_expression(ts, i, scope_stack, 0);
     if (!condition)
     {
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     debugPrintNode("After parse_expression - condition", condition);
-    printf("Condition parsed. Current token: %s\n", tokens[*i].value.str_val);
+    printf("Condition parsed. Current token: %s\n",
+           ts_text(ts, *i));
 
     // Check for closing parenthesis
-    if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, ")") != 0)
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_RPAREN))
     {
         printf("Error: Expected ')' after if condition at line %d\n",
-               tokens[*i].line);
-        free_ast(condition);
+               ts_line(ts, *i));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     (*i)++;
@@ -1221,8 +1016,7 @@ static Node *parse_if_statement(Token *tokens, size_t *i, size_t num_tokens,
     }
     else if (condition->type == NODE_IDENTIFIER)
     {
-        Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                 condition->value.str_val);
+        Symbol *sym = find_symbol_in_scope_stack(scope_stack, condition->atom);
         if (sym)
         {
             condition_active = sym->value != 0;
@@ -1230,30 +1024,37 @@ static Node *parse_if_statement(Token *tokens, size_t *i, size_t num_tokens,
     }
 
     // Parse then block with the condition status
-    Node *then_block = parse_block(tokens, i, num_tokens, scope_stack,
+    Node *then_block = parse_block(ts, i, scope_stack,
                                    condition_active);
     if (!then_block)
     {
-        free_ast(condition);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
-    printf("Then block parsed. Current token: %s\n", tokens[*i].value.str_val);
+    printf("Then block parsed. Current token: %s\n",
+           ts_text(ts, *i));
 
     // Create if node with proper structure
-    Node *if_node = createNode(NODE_IF_STATEMENT, "if", start_line, start_col);
+    Node *if_node = createNode(NODE_IF_STATEMENT, intern("if"),
+                               start_line, start_col);
     if (!if_node)
     {
-        free_ast(condition);
-        free_ast(then_block);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    if_node->left = condition;
-    condition->right = then_block; // Then-block is sibling of condition
+    if (syntax_only)
+    {
+        if_node->left = then_block;
+        then_block->right = condition;
+    }
+    else
+    {
+        if_node->left = condition;
+        condition->right = then_block; // Then-block is sibling of condition
+    }
 
     if (last_node_out)
         *last_node_out = if_node;
@@ -1267,8 +1068,7 @@ static Node *parse_if_statement(Token *tokens, size_t *i, size_t num_tokens,
     return if_node;
 }
 
-static Node *parse_else_if_statements(Token *tokens, size_t *i,
-                                      size_t num_tokens,
+static Node *parse_else_if_statements(TokenStream *ts, size_t *i,
                                       ScopeStack *scope_stack, Node *if_node,
                                       bool prev_condition_active,
                                       Node **last_else_if_out)
@@ -1277,50 +1077,47 @@ static Node *parse_else_if_statements(Token *tokens, size_t *i,
     bool any_condition_active = prev_condition_active;
 
     // Keep parsing else if statements as long as we find them
-    while (*i < num_tokens &&
-           tokens[*i].type == KEYWORD &&
-           strcmp(tokens[*i].value.str_val, "else") == 0 &&
-           *i + 1 < num_tokens &&
-           tokens[*i + 1].type == KEYWORD &&
-           strcmp(tokens[*i + 1].value.str_val, "if") == 0)
+    while (!ts_end(ts, *i) &&
+           is_keyword(ts, *i, KW_ELSE) &&
+           !ts_end(ts, *i + 1) &&
+           is_keyword(ts, *i + 1, KW_IF))
     {
-        int start_line = tokens[*i].line;
-        int start_col = tokens[*i].col;
+        int start_line = ts_line(ts, *i);
+        int start_col = ts_col(ts, *i);
 
         // Consume 'else if' keywords
         (*i)++; // 'else'
         (*i)++; // 'if'
 
         // Check for opening parenthesis
-        if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, "(") != 0)
+        if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_LPAREN))
         {
             printf("Error: Expected '(' after 'else if' at line %d\n",
-                   tokens[*i].line);
+                   ts_line(ts, *i));
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
         (*i)++;
 
         // Parse condition
-        Node *condition = parse_expression(tokens, i, num_tokens,
+        Node *condition = parse_expression(ts, i,
                                            scope_stack, 0);
         if (!condition)
         {
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
         debugPrintNode("After parse_expression - else if condition", condition);
 
         // Check for closing parenthesis
-        if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, ")") != 0)
+        if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_RPAREN))
         {
             printf("Error: Expected ')' after else if condition at line %d\n",
-                   tokens[*i].line);
-            free_ast(condition);
+                   ts_line(ts, *i));
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
         (*i)++;
@@ -1337,7 +1134,7 @@ static Node *parse_else_if_statements(Token *tokens, size_t *i,
             else if (condition->type == NODE_IDENTIFIER)
             {
                 Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                         condition->value.str_val);
+                                                         condition->atom);
                 if (sym)
                 {
                     condition_active = sym->value != 0;
@@ -1347,29 +1144,35 @@ static Node *parse_else_if_statements(Token *tokens, size_t *i,
         }
 
         // Parse then block
-        Node *else_if_block = parse_block(tokens, i, num_tokens,
+        Node *else_if_block = parse_block(ts, i,
                                           scope_stack, condition_active);
         if (!else_if_block)
         {
-            free_ast(condition);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
 
         // Create else if node
         Node *else_if_node = createNode(NODE_ELSE_IF_STATEMENT,
-                                        "else if", start_line, start_col);
+                                        intern("else if"), start_line,
+                                        start_col);
         if (!else_if_node)
         {
-            free_ast(condition);
-            free_ast(else_if_block);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
-        else_if_node->left = condition;
-        condition->right = else_if_block;
+        if (syntax_only)
+        {
+            else_if_node->left = else_if_block;
+            else_if_block->right = condition;
+        }
+        else
+        {
+            else_if_node->left = condition;
+            condition->right = else_if_block;
+        }
 
         // Link to the chain using last_else_if pointer
         if (!if_node->right)
@@ -1390,38 +1193,35 @@ static Node *parse_else_if_statements(Token *tokens, size_t *i,
     return last_else_if;
 }
 
-static Node *parse_else_statement(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_else_statement(TokenStream *ts, size_t *i,
                                   ScopeStack *scope_stack, Node **last_node_out)
 {
     // First check if we're starting with 'else' without preceding 'if'
-    if (tokens[*i].type == KEYWORD &&
-        strcmp(tokens[*i].value.str_val, "else") == 0)
+    if (is_keyword(ts, *i, KW_ELSE))
     {
         // Check if this is 'else if'
-        if (*i + 1 < num_tokens &&
-            tokens[*i + 1].type == KEYWORD &&
-            strcmp(tokens[*i + 1].value.str_val, "if") == 0)
+        if (!ts_end(ts, *i + 1) && is_keyword(ts, *i + 1, KW_IF))
         {
             printf("Error at line %d:%d: 'else if' without preceding 'if'\n",
-                   tokens[*i].line, tokens[*i].col);
+                   ts_line(ts, *i), ts_col(ts, *i));
         }
         else
         {
             printf("Error at line %d:%d: 'else' without preceding 'if'\n",
-                   tokens[*i].line, tokens[*i].col);
+                   ts_line(ts, *i), ts_col(ts, *i));
         }
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
     // Now parse the required if statement first
-    Node *if_node = parse_if_statement(tokens, i, num_tokens,
+    Node *if_node = parse_if_statement(ts, i,
                                        scope_stack, NULL);
     if (!if_node)
     {
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     Node *last_node = if_node;
@@ -1437,7 +1237,7 @@ static Node *parse_else_statement(Token *tokens, size_t *i, size_t num_tokens,
         else if (if_node->left->type == NODE_IDENTIFIER)
         {
             Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                     if_node->left->value.str_val);
+                                                     if_node->left->atom);
             if (sym)
             {
                 any_condition_active = sym->value != 0;
@@ -1447,7 +1247,7 @@ static Node *parse_else_statement(Token *tokens, size_t *i, size_t num_tokens,
 
     // Now parse any else if statements and get the last one
     Node *last_else_if = NULL;
-    parse_else_if_statements(tokens, i, num_tokens, scope_stack,
+    parse_else_if_statements(ts, i, scope_stack,
                              if_node, any_condition_active, &last_else_if);
 
     if (last_else_if)
@@ -1467,7 +1267,7 @@ static Node *parse_else_statement(Token *tokens, size_t *i, size_t num_tokens,
                 else if (current->left->type == NODE_IDENTIFIER)
                 {
                     Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                             current->left->value.str_val);
+                                                             current->left->atom);
                     if (sym)
                     {
                         any_condition_active = any_condition_active ||
@@ -1480,12 +1280,10 @@ static Node *parse_else_statement(Token *tokens, size_t *i, size_t num_tokens,
     }
 
     // Check for a final else clause
-    if (*i < num_tokens &&
-        tokens[*i].type == KEYWORD &&
-        strcmp(tokens[*i].value.str_val, "else") == 0)
+    if (!ts_end(ts, *i) && is_keyword(ts, *i, KW_ELSE))
     {
-        int start_line = tokens[*i].line;
-        int start_col = tokens[*i].col;
+        int start_line = ts_line(ts, *i);
+        int start_col = ts_col(ts, *i);
 
         // Consume 'else' keyword
         (*i)++;
@@ -1494,25 +1292,22 @@ static Node *parse_else_statement(Token *tokens, size_t *i, size_t num_tokens,
         bool else_active = !any_condition_active;
 
         // Parse else block
-        Node *else_block = parse_block(tokens, i, num_tokens, scope_stack,
+        Node *else_block = parse_block(ts, i, scope_stack,
                                        else_active);
         if (!else_block)
         {
-            free_ast(if_node);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
 
         // Create else node
         Node *else_node = createNode(NODE_ELSE_STATEMENT,
-                                     "else", start_line, start_col);
+                                     intern("else"), start_line, start_col);
         if (!else_node)
         {
-            free_ast(if_node);
-            free_ast(else_block);
             free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
+            token_stream_close(ts);
             exit(1);
         }
         else_node->left = else_block;
@@ -1542,509 +1337,585 @@ static Node *parse_else_statement(Token *tokens, size_t *i, size_t num_tokens,
     return if_node;
 }
 
-// DO-WHILE LOOP PARSER
-Node *parse_do_while_statement(Token *tokens, size_t *i, size_t num_tokens,
-                               ScopeStack *scope_stack)
-{
-    int start_line = tokens[*i].line;
-    int start_col = tokens[*i].col;
-
-    (*i)++; // consume 'do'
+// Loop Evaluation
+// These run a loop's syntax tree (see syntax_only) against the symbol
+// table, giving each statement the meaning the parser gives it outside
+// loops. With `build` set they also return the nodes the parser would have
+// built for that run, every expression folded to one literal; without it
+// they build no nodes at all.
 
-    Node *do_while_node = createNode(NODE_DO_WHILE_STATEMENT,
-                                     "do", start_line, start_col);
-    if (!do_while_node)
+static Symbol *evaluated_symbol(TokenStream *ts, const Node *identifier,
+                                ScopeStack *scope_stack)
+{
+    Symbol *sym = find_symbol_in_scope_stack(scope_stack, identifier->atom);
+    if (!sym)
     {
+        printf("Error: Undefined variable '%s' at line %d\n",
+               identifier->value.str_val, identifier->line);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
+    return sym;
+}
 
-    size_t block_start_pos = *i;
-    bool condition_active = true;
-
-    Node *first_condition = NULL;
-    Node *first_block = NULL;
-    bool first_iteration = true;
-
-    int iteration_count = 0;
-
-    do
-    {
-        iteration_count++;
-        size_t temp_i = block_start_pos;
+static int evaluate_expression(TokenStream *ts, const Node *expr,
+                               ScopeStack *scope_stack)
+{
+    if (expr->type == NODE_LITERAL_INT)
+        return expr->value.int_val;
+    if (expr->type == NODE_IDENTIFIER)
+        return evaluated_symbol(ts, expr, scope_stack)->value;
+
+    int left = evaluate_expression(ts, expr->left, scope_stack);
+    int right = evaluate_expression(ts, expr->right, scope_stack);
+    return fold_binary(expr->op, left, right);
+}
 
-        printf("[DEBUG] Do-While Iteration %d: Parsing block "
-               "at token index %zu\n",
-               iteration_count, temp_i);
+// The literal an expression folds to, where the parser would put it
+static Node *evaluated_literal(int value, const Node *expr)
+{
+    Node *literal = createNode(NODE_LITERAL_INT, ATOM_NONE, expr->line,
+                               expr->col);
+    literal->value.int_val = value;
+    return literal;
+}
 
-        // Parse block first (this is the key difference from while loop)
-        Node *block = parse_block(tokens, &temp_i, num_tokens,
-                                  scope_stack, condition_active);
-        if (!block)
-        {
-            printf("Error: Failed to parse do-while block\n");
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
-        }
+static Node *evaluate_block(TokenStream *ts, const Node *block,
+                            ScopeStack *scope_stack, bool condition_active,
+                            bool build);
 
-        printf("[DEBUG] Block parsed, checking for 'while' "
-               "keyword at token index %zu\n",
-               temp_i);
+// One node of a block's statement list. `any_condition_active` carries an
+// if's outcome on to the else if / else nodes that follow it.
+static Node *evaluate_statement(TokenStream *ts, const Node *stmt,
+                                ScopeStack *scope_stack,
+                                bool condition_active,
+                                bool *any_condition_active, bool build)
+{
+    Node *built = NULL;
 
-        // Expect 'while' keyword after the block
-        if (temp_i >= num_tokens)
+    switch (stmt->type)
+    {
+    case NODE_VAR_DECL:
+    {
+        int value = stmt->left
+                        ? evaluate_expression(ts, stmt->left, scope_stack)
+                        : 0;
+        if (condition_active)
         {
-            printf("Error: Unexpected end of input, expected 'while' "
-                   "after do block at line %d\n",
-                   tokens[temp_i - 1].line);
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
+            add_symbol(scope_stack, stmt->atom, VAR_INT, value, stmt->line,
+                       stmt->col);
         }
-
-        if (tokens[temp_i].type != KEYWORD ||
-            strcmp(tokens[temp_i].value.str_val, "while") != 0)
+        if (build)
         {
-            printf("Error: Expected 'while' after do block at "
-                   "line %d:%d, got '%s'\n",
-                   tokens[temp_i].line, tokens[temp_i].col,
-                   tokens[temp_i].value.str_val ? tokens[temp_i].value.str_val : "(null)");
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
+            built = createNode(NODE_VAR_DECL, stmt->atom, stmt->line,
+                               stmt->col);
+            if (stmt->left)
+                built->left = evaluated_literal(value, stmt->left);
         }
-        temp_i++; // consume 'while'
+        break;
+    }
+    case NODE_ASSIGNMENT:
+    {
+        const Node *lhs = stmt->left;
+        const Node *value = lhs->right;
+        const Node *expr = stmt->op == OP_ASSIGN ? value : value->right;
 
-        // Expect opening parenthesis
-        if (temp_i >= num_tokens)
-        {
-            printf("Error: Unexpected end of input, expected '(' after "
-                   "'while' at line %d\n",
-                   tokens[temp_i - 1].line);
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
-        }
+        Symbol *target = evaluated_symbol(ts, lhs, scope_stack);
+        int rhs_value = evaluate_expression(ts, expr, scope_stack);
+        int result = stmt->op == OP_ASSIGN
+                         ? rhs_value
+                         : compound_result(value->op, target->value,
+                                           rhs_value);
+        if (condition_active)
+            target->value = result;
 
-        if (strcmp(tokens[temp_i].value.str_val, "(") != 0)
+        if (build)
         {
-            printf("Error: Expected '(' after 'while' at "
-                   "line %d:%d, got '%s'\n",
-                   tokens[temp_i].line, tokens[temp_i].col,
-                   tokens[temp_i].value.str_val ? tokens[temp_i].value.str_val : "(null)");
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
+            built = createNode(NODE_ASSIGNMENT, stmt->atom, stmt->line,
+                               stmt->col);
+            built->op = OP_ASSIGN;
+            built->left = createNode(NODE_IDENTIFIER, lhs->atom, lhs->line,
+                                     lhs->col);
+            if (stmt->op == OP_ASSIGN)
+            {
+                built->right = evaluated_literal(rhs_value, expr);
+            }
+            else if (condition_active)
+            {
+                built->right = evaluated_literal(result, value);
+            }
+            else
+            {
+                // Not run: "x op e" stays, with only e folded
+                Node *bin_op = createNode(NODE_BINARY_EXPR, value->atom,
+                                          value->line, value->col);
+                bin_op->op = value->op;
+                bin_op->left = createNode(NODE_IDENTIFIER, lhs->atom,
+                                          lhs->line, lhs->col);
+                bin_op->right = evaluated_literal(rhs_value, expr);
+                built->right = bin_op;
+            }
         }
-        temp_i++; // consume '('
-
-        printf("[DEBUG] Parsing condition at token index %zu\n", temp_i);
-
-        Node *condition = parse_expression(tokens, &temp_i, num_tokens,
-                                           scope_stack, 0);
-        if (!condition)
+        break;
+    }
+    case NODE_EXIT_CALL:
+    {
+        int value = evaluate_expression(ts, stmt->left, scope_stack);
+        if (build)
         {
-            printf("Error: Failed to parse do-while condition\n");
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
+            built = createNode(NODE_EXIT_CALL, stmt->atom, stmt->line,
+                               stmt->col);
+            built->left = evaluated_literal(value, stmt->left);
         }
+        break;
+    }
+    case NODE_IF_STATEMENT:
+    case NODE_ELSE_IF_STATEMENT:
+    {
+        const Node *condition = stmt->left->right;
+        int value = evaluate_expression(ts, condition, scope_stack);
 
-        printf("[DEBUG] Condition type: %d\n", condition->type);
-
-        // Expect closing parenthesis
-        if (temp_i >= num_tokens)
-        {
-            printf("Error: Unexpected end of input, expected ')' "
-                   "after do-while condition at line %d\n",
-                   tokens[temp_i - 1].line);
-            free_ast(condition);
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
-        }
+        // An if starts a new chain; an else if is only active if no
+        // earlier condition of its chain was true
+        bool active = value != 0;
+        if (stmt->type == NODE_IF_STATEMENT)
+            *any_condition_active = false;
+        else if (*any_condition_active)
+            active = false;
+        *any_condition_active = active || *any_condition_active;
 
-        if (strcmp(tokens[temp_i].value.str_val, ")") != 0)
+        Node *block = evaluate_block(ts, stmt->left, scope_stack, active,
+                                     build);
+        if (build)
         {
-            printf("Error: Expected ')' after do-while condition "
-                   "at line %d:%d, got '%s'\n",
-                   tokens[temp_i].line, tokens[temp_i].col,
-                   tokens[temp_i].value.str_val ? tokens[temp_i].value.str_val : "(null)");
-            free_ast(condition);
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
+            built = createNode(stmt->type, stmt->atom, stmt->line,
+                               stmt->col);
+            built->left = evaluated_literal(value, condition);
+            built->left->right = block;
         }
-        temp_i++; // consume ')'
-
-        // Expect semicolon
-        if (temp_i >= num_tokens)
+        break;
+    }
+    case NODE_ELSE_STATEMENT:
+    {
+        Node *block = evaluate_block(ts, stmt->left, scope_stack,
+                                     !*any_condition_active, build);
+        if (build)
         {
-            printf("Error: Unexpected end of input, expected ';' "
-                   "after do-while statement at line %d\n",
-                   tokens[temp_i - 1].line);
-            free_ast(condition);
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
+            built = createNode(NODE_ELSE_STATEMENT, stmt->atom, stmt->line,
+                               stmt->col);
+            built->left = block;
         }
+        break;
+    }
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        // Loops run whether or not the enclosing block is active
+        built = evaluate_loop(ts, stmt, scope_stack, build);
+        break;
+    case NODE_BLOCK:
+        built = evaluate_block(ts, stmt, scope_stack, condition_active,
+                               build);
+        break;
+    default:
+        printf("Error: Unsupported statement at line %d\n", stmt->line);
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
 
-        if (strcmp(tokens[temp_i].value.str_val, ";") != 0)
-        {
-            printf("Error: Expected ';' after do-while statement at "
-                   "line %d:%d, got '%s'\n",
-                   tokens[temp_i].line, tokens[temp_i].col,
-                   tokens[temp_i].value.str_val ? tokens[temp_i].value.str_val : "(null)");
-            free_ast(condition);
-            free_ast(block);
-            free_ast(do_while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
-        }
-        temp_i++; // consume ';'
+    return built;
+}
 
-        // Evaluate condition with current symbol table state
-        // (AFTER executing the block)
-        if (condition->type == NODE_LITERAL_INT)
-        {
-            condition_active = condition->value.int_val != 0;
-        }
-        else if (condition->type == NODE_IDENTIFIER)
-        {
-            Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                     condition->value.str_val);
-            condition_active = sym ? (sym->value != 0) : false;
-        }
+static Node *evaluate_block(TokenStream *ts, const Node *block,
+                            ScopeStack *scope_stack, bool condition_active,
+                            bool build)
+{
+    push_scope(scope_stack);
 
-        printf("[DEBUG] Condition active: %d\n", condition_active);
+    Node *block_node = NULL;
+    Node *current_stmt = NULL;
+    if (build)
+        block_node = createNode(NODE_BLOCK, block->atom, block->line,
+                                block->col);
 
-        if (first_iteration)
-        {
-            // Keep ONLY the first iteration nodes for AST/codegen
-            first_block = block;
-            first_condition = condition;
-            first_iteration = false;
-            printf("[DEBUG] Saved first iteration nodes for AST\n");
-        }
+    bool any_condition_active = false;
+    for (const Node *stmt = block->left; stmt; stmt = stmt->right)
+    {
+        Node *built = evaluate_statement(ts, stmt, scope_stack,
+                                         condition_active,
+                                         &any_condition_active, build);
+        if (!built)
+            continue;
+        if (!block_node->left)
+            block_node->left = built;
         else
-        {
-            // Free subsequent iteration nodes - we only needed
-            // their side effects on symbol table
-            free_ast(block);
-            free_ast(condition);
-            printf("[DEBUG] Freed iteration %d nodes "
-                   "(kept symbol table effects)\n",
-                   iteration_count);
-        }
+            current_stmt->right = built;
+        current_stmt = built;
+    }
 
-    } while (condition_active);
+    pop_scope(scope_stack);
+    return block_node;
+}
 
-    // Link ONLY the first iteration nodes to the do_while_node AST
-    // Structure: do_while_node->left = first_block,
-    // first_block->right = first_condition
-    do_while_node->left = first_block;
-    if (first_block)
-        first_block->right = first_condition;
+// Run a loop to completion. With `build`, returns the loop node with the
+// nodes of its first iteration, the only ones kept for codegen.
+static Node *evaluate_loop(TokenStream *ts, const Node *loop,
+                           ScopeStack *scope_stack, bool build)
+{
+    bool do_while = loop->type == NODE_DO_WHILE_STATEMENT;
+    const Node *body = loop->left;
+    const Node *condition = body->right;
 
-    // Advance parser index past the entire do-while statement
-    *i = block_start_pos;
+    Node *first_condition = NULL;
+    Node *first_block = NULL;
+    int iteration_count = 0;
+    bool tried_fast_paths = false;
 
-    // Skip past block parsing
-    Node *temp_block = parse_block(tokens, i, num_tokens, scope_stack, false);
-    if (temp_block)
+    for (;;)
     {
-        free_ast(temp_block); // Free the temporary block
-    }
+        bool keep = build && iteration_count == 0;
+        Node *block = NULL;
 
-    // Skip past 'while' keyword
-    if (*i < num_tokens && tokens[*i].type == KEYWORD &&
-        strcmp(tokens[*i].value.str_val, "while") == 0)
-    {
-        (*i)++; // skip 'while'
-    }
+        // Nothing is built past the first iteration, so the rest of the
+        // loop can be taken in one step, if it is an induction or affine
+        // loop, or run as bytecode, if it compiles
+        if (!keep && !tried_fast_paths)
+        {
+            tried_fast_paths = true;
+            int rest = 0;
+            if ((LOOP_INDUCTION &&
+                 induction_run_loop(loop, scope_stack, &rest)) ||
+                (LOOP_AFFINE && affine_run_loop(loop, scope_stack, &rest)) ||
+                (LOOP_VM && vm_run_loop(loop, scope_stack, &rest)))
+            {
+                iteration_count += rest;
+                break;
+            }
+        }
 
-    // Skip past '('
-    if (*i < num_tokens && tokens[*i].type == SEPARATOR &&
-        strcmp(tokens[*i].value.str_val, "(") == 0)
-    {
-        (*i)++; // skip '('
-    }
+        // A do-while runs its body before the first test
+        if (do_while)
+            block = evaluate_block(ts, body, scope_stack, true, keep);
 
-    // Skip past condition parsing
-    Node *temp_condition = parse_expression(tokens, i, num_tokens,
-                                            scope_stack, 0);
-    if (temp_condition)
-    {
-        free_ast(temp_condition); // Free the temporary condition
+        int value = evaluate_expression(ts, condition, scope_stack);
+        if (keep && (do_while || value != 0))
+            first_condition = evaluated_literal(value, condition);
+        if (!do_while && value != 0)
+            block = evaluate_block(ts, body, scope_stack, true, keep);
+
+        if (keep)
+            first_block = block;
+        if (do_while || value != 0)
+            iteration_count++;
+        if (value == 0)
+            break;
     }
 
-    // Skip past ')' and ';'
-    if (*i < num_tokens && tokens[*i].type == SEPARATOR &&
-        strcmp(tokens[*i].value.str_val, ")") == 0)
+    if (!build)
+        return NULL;
+
+    Node *loop_node = createNode(loop->type, loop->atom, loop->line,
+                                 loop->col);
+    if (do_while)
     {
-        (*i)++; // skip ')'
+        // Structure: do_while_node->left = first_block,
+        // first_block->right = first_condition
+        loop_node->left = first_block;
+        first_block->right = first_condition;
     }
-    if (*i < num_tokens && tokens[*i].type == SEPARATOR &&
-        strcmp(tokens[*i].value.str_val, ";") == 0)
+    else
     {
-        (*i)++; // skip ';'
+        loop_node->left = first_condition;
+        if (first_condition)
+            first_condition->right = first_block;
     }
 
-    printf("[DEBUG] Do-While loop completed: %d iterations unrolled, "
+    printf("[DEBUG] %s loop completed: %d iterations evaluated, "
            "first iteration kept for AST\n",
-           iteration_count);
+           do_while ? "Do-While" : "While", iteration_count);
 
-    return do_while_node;
+    return loop_node;
 }
 
-// WHILE LOOP PARSER
-Node *parse_while_statement(Token *tokens, size_t *i, size_t num_tokens,
-                            ScopeStack *scope_stack)
+// Loops are read once, as syntax (see syntax_only). Inside another loop
+// that is all; otherwise the loop is run here and its first iteration is
+// what the caller gets back.
+static Node *finish_loop(TokenStream *ts, Node *loop,
+                         ScopeStack *scope_stack, bool outermost,
+                         ArenaMark syntax_mark)
 {
-    int start_line = tokens[*i].line;
-    int start_col = tokens[*i].col;
+    if (!outermost)
+        return loop;
 
-    (*i)++; // consume 'while'
+    syntax_only = false;
+    Node *loop_node = evaluate_loop(ts, loop, scope_stack, true);
+    arena_release(&syntax_arena, syntax_mark);
+    return loop_node;
+}
+
+// DO-WHILE LOOP PARSER
+Node *parse_do_while_statement(TokenStream *ts, size_t *i,
+                               ScopeStack *scope_stack)
+{
+    int start_line = ts_line(ts, *i);
+    int start_col = ts_col(ts, *i);
 
-    if (*i >= num_tokens || strcmp(tokens[*i].value.str_val, "(") != 0)
+    (*i)++; // consume 'do'
+
+    bool outermost = !syntax_only;
+    ArenaMark syntax_mark = arena_mark(&syntax_arena);
+    syntax_only = true;
+
+    Node *do_while_node = createNode(NODE_DO_WHILE_STATEMENT,
+                                     intern("do"), start_line, start_col);
+    if (!do_while_node)
     {
-        printf("Error: Expected '(' after 'while' at line %d\n",
-               tokens[*i].line);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
-    (*i)++; // consume '('
 
-    Node *while_node = createNode(NODE_WHILE_STATEMENT, "while", start_line,
-                                  start_col);
-    if (!while_node)
+    // Parse block first (this is the key difference from while loop)
+    Node *block = parse_block(ts, i, scope_stack, true);
+    if (!block)
     {
+        printf("Error: Failed to parse do-while block\n");
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    size_t loop_start_pos = *i;
-    bool condition_active = true;
+    // Expect 'while' keyword after the block
+    if (ts_end(ts, *i))
+    {
+        printf("Error: Unexpected end of input, expected 'while' "
+               "after do block at line %d\n",
+               ts_line(ts, *i - 1));
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
 
-    Node *first_condition = NULL;
-    Node *first_block = NULL;
-    bool first_iteration = true;
+    if (!is_keyword(ts, *i, KW_WHILE))
+    {
+        printf("Error: Expected 'while' after do block at "
+               "line %d:%d, got '%s'\n",
+               ts_line(ts, *i), ts_col(ts, *i),
+               ts_text(ts, *i) ? ts_text(ts, *i) : "(null)");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
+    (*i)++; // consume 'while'
 
-    int iteration_count = 0;
+    // Expect opening parenthesis
+    if (ts_end(ts, *i))
+    {
+        printf("Error: Unexpected end of input, expected '(' after "
+               "'while' at line %d\n",
+               ts_line(ts, *i - 1));
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
 
-    while (condition_active)
+    if (!is_separator(ts, *i, SEP_LPAREN))
     {
-        iteration_count++;
-        size_t temp_i = loop_start_pos;
+        printf("Error: Expected '(' after 'while' at "
+               "line %d:%d, got '%s'\n",
+               ts_line(ts, *i), ts_col(ts, *i),
+               ts_text(ts, *i) ? ts_text(ts, *i) : "(null)");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
+    (*i)++; // consume '('
 
-        printf("[DEBUG] Iteration %d: Parsing condition at token index %zu\n",
-               iteration_count, temp_i);
+    Node *condition = parse_expression(ts, i, scope_stack, 0);
+    if (!condition)
+    {
+        printf("Error: Failed to parse do-while condition\n");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
 
-        Node *condition = parse_expression(tokens, &temp_i, num_tokens,
-                                           scope_stack, 0);
-        if (!condition)
-        {
-            printf("Error: Failed to parse while condition\n");
-            free_ast(while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
-        }
+    // Expect closing parenthesis
+    if (ts_end(ts, *i))
+    {
+        printf("Error: Unexpected end of input, expected ')' "
+               "after do-while condition at line %d\n",
+               ts_line(ts, *i - 1));
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
 
-        printf("[DEBUG] Condition type: %d\n", condition->type);
+    if (!is_separator(ts, *i, SEP_RPAREN))
+    {
+        printf("Error: Expected ')' after do-while condition "
+               "at line %d:%d, got '%s'\n",
+               ts_line(ts, *i), ts_col(ts, *i),
+               ts_text(ts, *i) ? ts_text(ts, *i) : "(null)");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
+    (*i)++; // consume ')'
 
-        if (temp_i >= num_tokens ||
-            strcmp(tokens[temp_i].value.str_val, ")") != 0)
-        {
-            printf("Error: Expected ')' after while condition\n");
-            free_ast(condition);
-            free_ast(while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
-        }
-        temp_i++; // consume ')'
+    // Expect semicolon
+    if (ts_end(ts, *i))
+    {
+        printf("Error: Unexpected end of input, expected ';' "
+               "after do-while statement at line %d\n",
+               ts_line(ts, *i - 1));
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
 
-        // Evaluate condition with current symbol table state
-        if (condition->type == NODE_LITERAL_INT)
-        {
-            condition_active = condition->value.int_val != 0;
-        }
-        else if (condition->type == NODE_IDENTIFIER)
-        {
-            Symbol *sym = find_symbol_in_scope_stack(scope_stack,
-                                                     condition->value.str_val);
-            condition_active = sym ? (sym->value != 0) : false;
-        }
+    if (!is_separator(ts, *i, SEP_SEMICOLON))
+    {
+        printf("Error: Expected ';' after do-while statement at "
+               "line %d:%d, got '%s'\n",
+               ts_line(ts, *i), ts_col(ts, *i),
+               ts_text(ts, *i) ? ts_text(ts, *i) : "(null)");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
+    (*i)++; // consume ';'
 
-        printf("[DEBUG] Condition active: %d\n", condition_active);
+    do_while_node->left = block;
+    block->right = condition;
 
-        if (!condition_active)
-        {
-            // Condition false: free current condition and break
-            free_ast(condition);
-            break;
-        }
+    return finish_loop(ts, do_while_node, scope_stack, outermost,
+                       syntax_mark);
+}
 
-        printf("[DEBUG] Parsing block starting at token index %zu\n", temp_i);
+// WHILE LOOP PARSER
+Node *parse_while_statement(TokenStream *ts, size_t *i,
+                            ScopeStack *scope_stack)
+{
+    int start_line = ts_line(ts, *i);
+    int start_col = ts_col(ts, *i);
 
-        // Parse block - this updates symbol table for semantic analysis
-        Node *block = parse_block(tokens, &temp_i, num_tokens, scope_stack,
-                                  condition_active);
-        if (!block)
-        {
-            printf("Error: Failed to parse while block\n");
-            free_ast(condition);
-            free_ast(while_node);
-            free_scope_stack(scope_stack);
-            free_tokens(tokens, num_tokens);
-            exit(1);
-        }
+    (*i)++; // consume 'while'
 
-        if (first_iteration)
-        {
-            // Keep ONLY the first iteration nodes for AST/codegen
-            first_condition = condition;
-            first_block = block;
-            first_iteration = false;
-            printf("[DEBUG] Saved first iteration nodes for AST\n");
-        }
-        else
-        {
-            // Free subsequent iteration nodes - we only needed
-            // their side effects on symbol table
-            free_ast(condition);
-            free_ast(block);
-            printf("[DEBUG] Freed iteration %d nodes "
-                   "(kept symbol table effects)\n",
-                   iteration_count);
-        }
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_LPAREN))
+    {
+        printf("Error: Expected '(' after 'while' at line %d\n",
+               ts_line(ts, *i));
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
     }
+    (*i)++; // consume '('
 
-    // Link ONLY the first iteration nodes to the while_node AST
-    while_node->left = first_condition;
-    if (first_condition)
-        first_condition->right = first_block;
+    bool outermost = !syntax_only;
+    ArenaMark syntax_mark = arena_mark(&syntax_arena);
+    syntax_only = true;
 
-    // Advance parser index past the entire while statement
-    *i = loop_start_pos;
+    Node *while_node = createNode(NODE_WHILE_STATEMENT, intern("while"),
+                                  start_line, start_col);
+    if (!while_node)
+    {
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
+    }
 
-    // Skip past condition parsing
-    Node *temp_condition = parse_expression(tokens, i, num_tokens,
-                                            scope_stack, 0);
-    if (temp_condition)
+    Node *condition = parse_expression(ts, i, scope_stack, 0);
+    if (!condition)
     {
-        free_ast(temp_condition); // Free the temporary condition
+        printf("Error: Failed to parse while condition\n");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
     }
 
-    if (*i < num_tokens && strcmp(tokens[*i].value.str_val, ")") == 0)
+    if (ts_end(ts, *i) || !is_separator(ts, *i, SEP_RPAREN))
     {
-        (*i)++; // skip ')'
+        printf("Error: Expected ')' after while condition\n");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
     }
+    (*i)++; // consume ')'
 
-    // Skip past block parsing
-    Node *temp_block = parse_block(tokens, i, num_tokens, scope_stack, false);
-    if (temp_block)
+    Node *block = parse_block(ts, i, scope_stack, true);
+    if (!block)
     {
-        free_ast(temp_block); // Free the temporary block
+        printf("Error: Failed to parse while block\n");
+        free_scope_stack(scope_stack);
+        token_stream_close(ts);
+        exit(1);
     }
 
-    printf("[DEBUG] While loop completed: %d iterations unrolled, "
-           "first iteration kept for AST\n",
-           iteration_count);
+    while_node->left = block;
+    block->right = condition;
 
-    return while_node;
+    return finish_loop(ts, while_node, scope_stack, outermost, syntax_mark);
 }
 
-static Node *parse_statement(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_statement(TokenStream *ts, size_t *i,
                              ScopeStack *scope_stack, Node **last_node_out,
                              bool condition_active)
 {
-    if (*i >= num_tokens)
+    if (ts_end(ts, *i))
     {
         return NULL;
     }
 
-    Token token = tokens[*i];
     Node *stmt = NULL;
     Node *last_node = NULL;
 
-    if (token.type == KEYWORD && strcmp(token.value.str_val, "int") == 0)
+    if (is_keyword(ts, *i, KW_INT))
     {
-        stmt = parse_variable_declaration(tokens, i, num_tokens, scope_stack,
+        stmt = parse_variable_declaration(ts, i, scope_stack,
                                           &last_node, condition_active);
     }
-    else if (token.type == KEYWORD && strcmp(token.value.str_val, "exit") == 0)
+    else if (is_keyword(ts, *i, KW_EXIT))
     {
-        stmt = parse_exit_statement(tokens, i, num_tokens, scope_stack);
+        stmt = parse_exit_statement(ts, i, scope_stack);
         last_node = stmt;
     }
-    else if (token.type == KEYWORD &&
-             ((strcmp(token.value.str_val, "if") == 0) ||
-              (strcmp(token.value.str_val, "else") == 0)))
+    else if (is_keyword(ts, *i, KW_IF) || is_keyword(ts, *i, KW_ELSE))
     {
-        stmt = parse_else_statement(tokens, i, num_tokens, scope_stack,
+        stmt = parse_else_statement(ts, i, scope_stack,
                                     &last_node);
     }
-    else if (token.type == KEYWORD &&
-             strcmp(token.value.str_val, "while") == 0)
+    else if (is_keyword(ts, *i, KW_WHILE))
     {
-        stmt = parse_while_statement(tokens, i, num_tokens, scope_stack);
+        stmt = parse_while_statement(ts, i, scope_stack);
         last_node = stmt;
     }
-    else if (token.type == KEYWORD && strcmp(token.value.str_val, "do") == 0)
+    else if (is_keyword(ts, *i, KW_DO))
     {
-        stmt = parse_do_while_statement(tokens, i, num_tokens, scope_stack);
+        stmt = parse_do_while_statement(ts, i, scope_stack);
         last_node = stmt;
     }
-    else if (token.type == SEPARATOR && strcmp(token.value.str_val, "{") == 0)
+    else if (is_separator(ts, *i, SEP_LBRACE))
     {
-        stmt = parse_block(tokens, i, num_tokens, scope_stack, condition_active);
+        stmt = parse_block(ts, i, scope_stack, condition_active);
         last_node = stmt;
     }
-    else if (token.type == IDENTIFIER &&
-             *i + 1 < num_tokens &&
-             tokens[*i + 1].type == OPERATOR &&
-             (strcmp(tokens[*i + 1].value.str_val, "=") == 0 ||
-              strcmp(tokens[*i + 1].value.str_val, "+=") == 0 ||
-              strcmp(tokens[*i + 1].value.str_val, "-=") == 0 ||
-              strcmp(tokens[*i + 1].value.str_val, "*=") == 0 ||
-              strcmp(tokens[*i + 1].value.str_val, "/=") == 0 ||
-              strcmp(tokens[*i + 1].value.str_val, "%=") == 0 ||
-              strcmp(tokens[*i + 1].value.str_val, "<<=") == 0 ||
-              strcmp(tokens[*i + 1].value.str_val, ">>=") == 0))
-    {
-        stmt = parse_assignment_statement(tokens, i, num_tokens, scope_stack,
+    else if (ts_type(ts, *i) == IDENTIFIER &&
+             !ts_end(ts, *i + 1) &&
+             ts_type(ts, *i + 1) == OPERATOR &&
+             is_assignment_op(ts_op(ts, *i + 1)))
+    {
+        stmt = parse_assignment_statement(ts, i, scope_stack,
                                           condition_active);
         last_node = stmt;
     }
     else
     {
-        printf("Error: Unsupported statement at line %d\n", token.line);
+        printf("Error: Unsupported statement at line %d\n",
+               ts_line(ts, *i));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
@@ -2055,64 +1926,53 @@ static Node *parse_statement(Token *tokens, size_t *i, size_t num_tokens,
     return stmt;
 }
 
-static Node *parse_block(Token *tokens, size_t *i, size_t num_tokens,
+static Node *parse_block(TokenStream *ts, size_t *i,
                          ScopeStack *scope_stack, bool condition_active)
 {
-    if (*i >= num_tokens)
+    if (ts_end(ts, *i))
     {
         printf("Error: Unexpected end of input, expected '{'\n");
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
 
-    Token token = tokens[*i];
-    if (token.type != SEPARATOR || strcmp(token.value.str_val, "{") != 0)
+    if (!is_separator(ts, *i, SEP_LBRACE))
     {
-        printf("Error: Expected '{' at line %d\n", token.line);
+        printf("Error: Expected '{' at line %d\n", ts_line(ts, *i));
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
+    Token token = ts_token(ts, *i);
     (*i)++;
 
     // Create new scope
-    SymbolTable *block_scope = create_symbol_table();
-    if (!block_scope)
-    {
-        printf("Error: Failed to create symbol table\n");
-        free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
-        exit(1);
-    }
-    push_scope(scope_stack, block_scope);
+    push_scope(scope_stack);
 
-    Node *block_node = createNode(NODE_BLOCK, "{", token.line, token.col);
+    Node *block_node = createNode(NODE_BLOCK, token.atom, token.line,
+                                  token.col);
     if (!block_node)
     {
         pop_scope(scope_stack);
-        free_symbol_table(block_scope);
         free_scope_stack(scope_stack);
-        free_tokens(tokens, num_tokens);
+        token_stream_close(ts);
         exit(1);
     }
     Node *current_stmt = NULL;
 
-    while (*i < num_tokens)
+    while (!ts_end(ts, *i))
     {
-        token = tokens[*i];
-
         // Check for end of block
-        if (token.type == SEPARATOR && strcmp(token.value.str_val, "}") == 0)
+        if (is_separator(ts, *i, SEP_RBRACE))
         {
             (*i)++;
             pop_scope(scope_stack);
-            free_symbol_table(block_scope);
             return block_node;
         }
 
         Node *last_node = NULL;
-        Node *stmt = parse_statement(tokens, i, num_tokens, scope_stack,
+        Node *stmt = parse_statement(ts, i, scope_stack,
                                      &last_node, condition_active);
 
         if (stmt)
@@ -2131,18 +1991,16 @@ static Node *parse_block(Token *tokens, size_t *i, size_t num_tokens,
     }
 
     printf("Error: Unexpected end of input before closing '}'\n");
-    free_ast(block_node);
     pop_scope(scope_stack);
-    free_symbol_table(block_scope);
     free_scope_stack(scope_stack);
-    free_tokens(tokens, num_tokens);
+    token_stream_close(ts);
     exit(1);
 }
 
 // Main Parser
-Node *parse(Token *tokens, size_t num_tokens)
+Node *parse(TokenStream *ts)
 {
-    if (num_tokens == 0)
+    if (ts_end(ts, 0))
         return NULL;
 
     ScopeStack *scope_stack = create_scope_stack();
@@ -2152,16 +2010,9 @@ Node *parse(Token *tokens, size_t num_tokens)
         return NULL;
     }
 
-    SymbolTable *global_scope = create_symbol_table();
-    if (!global_scope)
-    {
-        printf("Error: Failed to create global scope\n");
-        free_scope_stack(scope_stack);
-        return NULL;
-    }
-    push_scope(scope_stack, global_scope); // Global scope
+    push_scope(scope_stack); // Global scope
 
-    Node *root = createNode(NODE_BEGIN, "program", 0, 0);
+    Node *root = createNode(NODE_BEGIN, intern("program"), 0, 0);
     if (!root)
     {
         printf("Error: Failed to create root node\n");
@@ -2170,12 +2021,12 @@ Node *parse(Token *tokens, size_t num_tokens)
     }
     Node *current = NULL;
 
-    for (size_t i = 0; i < num_tokens;)
+    for (size_t i = 0; !ts_end(ts, i);)
     {
         Node *last_node = NULL;
 
         // Default condition is true
-        Node *stmt = parse_statement(tokens, &i, num_tokens, scope_stack,
+        Node *stmt = parse_statement(ts, &i, scope_stack,
                                      &last_node, true);
         if (!stmt)
         {
@@ -4,6 +4,7 @@
 // "...define it now."
 
 #include "../lexer/lexer.h"
+#include "../lexer/stream.h"
 
 typedef enum
 {
@@ -31,10 +32,12 @@ typedef enum
 typedef struct Node
 {
     NodeType type;
+    Atom atom; // interned text, ATOM_NONE for literals
+    OpKind op; // operator of NODE_BINARY_EXPR / NODE_ASSIGNMENT
     union
     {
         int int_val;
-        char *str_val;
+        const char *str_val; // canonical pointer, equal to atom_str(atom)
     } value;
     int line;
     int col;
@@ -52,31 +55,36 @@ typedef enum
 
 typedef struct Symbol
 {
-    char *name;
+    Atom atom;        // name equality is an atom compare
+    const char *name; // interned, owned by the string pool
     VarType type;
     int value;
     int line;
     int col;
+    uint32_t shadowed; // undo entry: the binding this one hides, index + 1
 } Symbol;
 
-typedef struct SymbolTable
-{
-    Symbol *symbols;
-    size_t size;
-    size_t capacity;
-} SymbolTable;
-
+// Every scope's symbols in one array, innermost scope last. Entering a
+// scope records where its symbols start; leaving it truncates the array
+// back to there and undoes its bindings. Neither allocates once the arrays
+// have grown to the program's deepest nesting and most names in scope.
 typedef struct ScopeStack
 {
-    SymbolTable **tables;
+    Symbol *symbols;
     size_t size;
     size_t capacity;
+    size_t *scope_starts; // first symbol of each open scope
+    size_t depth;
+    size_t depth_capacity;
+    uint32_t *bindings;  // by atom: index + 1 of the visible symbol, 0: none
+    size_t num_bindings; // atoms covered by `bindings`
 } ScopeStack;
 
-Node *parse(Token *tokens, size_t num_tokens);
-void free_ast(Node *node);
+// Innermost visible declaration of `name`, NULL if there is none
+Symbol *find_symbol_in_scope_stack(ScopeStack *stack, Atom name);
 
-// left child right sibling
-void treeTraversal(Node *node, int depth);
+Node *parse(TokenStream *ts);
+// Frees the tree parse() returned: all of its nodes in one step
+void free_ast(Node *root);
 
 #endif // PARSER_H
\ No newline at end of file
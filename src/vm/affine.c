@@ -0,0 +1,606 @@
+#include "affine.h"
+
+// The body is run once symbolically, when the loop is analysed. Every
+// value in it is an affine form over the values the variables had when the
+// pass began: a coefficient per variable plus a constant, all mod 2^32.
+// The forms the variables end the pass with are the rows of the pass's
+// matrix, with one more row and column for the constant term; variables
+// the body never assigns keep identity rows.
+//
+// `x * n`, with n never assigned, is affine too, but only once n's value
+// is known. Such a product is deferred, and a body that has one is run
+// symbolically again each time the loop starts, with the unassigned
+// variables as constants.
+
+#define CONSTANT AFFINE_MAX_VARS // the constant term's slot in a form
+#define MAX_DIM (AFFINE_MAX_VARS + 1)
+
+typedef struct
+{
+    uint32_t coef[MAX_DIM];
+    bool deferred; // needs the unassigned variables' values
+} AffineForm;
+
+typedef struct
+{
+    const AffineLoop *loop;
+    AffineLoop *collect; // while analysing: where new names go
+    AffineForm state[AFFINE_MAX_VARS];
+    Atom local_atoms[AFFINE_MAX_LOCALS];
+    AffineForm locals[AFFINE_MAX_LOCALS];
+    int num_locals;
+} Pass;
+
+typedef uint32_t Matrix[MAX_DIM][MAX_DIM];
+
+static void constant_form(AffineForm *form, uint32_t value)
+{
+    memset(form, 0, sizeof(*form));
+    form->coef[CONSTANT] = value;
+}
+
+static void unit_form(AffineForm *form, int var)
+{
+    memset(form, 0, sizeof(*form));
+    form->coef[var] = 1;
+}
+
+static void defer(AffineForm *form)
+{
+    memset(form, 0, sizeof(*form));
+    form->deferred = true;
+}
+
+static bool is_constant(const AffineForm *form)
+{
+    if (form->deferred)
+        return false;
+    for (int v = 0; v < AFFINE_MAX_VARS; v++)
+    {
+        if (form->coef[v] != 0)
+            return false;
+    }
+    return true;
+}
+
+static void scale_form(AffineForm *out, const AffineForm *form,
+                       uint32_t factor)
+{
+    for (int d = 0; d < MAX_DIM; d++)
+        out->coef[d] = form->coef[d] * factor;
+    out->deferred = form->deferred;
+}
+
+static AffineForm *local_form(Pass *pass, Atom atom)
+{
+    for (int l = pass->num_locals; l-- > 0;)
+    {
+        if (pass->local_atoms[l] == atom)
+            return &pass->locals[l];
+    }
+    return NULL;
+}
+
+// Index of a name from outside the body, -1 past AFFINE_MAX_VARS
+static int outer_var(Pass *pass, Atom atom)
+{
+    const AffineLoop *loop = pass->loop;
+    for (int v = 0; v < loop->num_vars; v++)
+    {
+        if (loop->vars[v] == atom)
+            return v;
+    }
+    if (!pass->collect || loop->num_vars == AFFINE_MAX_VARS)
+        return -1;
+
+    int v = pass->collect->num_vars++;
+    pass->collect->vars[v] = atom;
+    pass->collect->assigned[v] = false;
+    unit_form(&pass->state[v], v);
+    return v;
+}
+
+// While analysing, a product or shift whose sides are both variable is
+// deferred: one side may be a name the body never assigns
+static bool form_of(Pass *pass, const Node *expr, AffineForm *out)
+{
+    switch (expr->type)
+    {
+    case NODE_LITERAL_INT:
+        constant_form(out, (uint32_t)expr->value.int_val);
+        return true;
+    case NODE_IDENTIFIER:
+    {
+        AffineForm *local = local_form(pass, expr->atom);
+        int v = local ? 0 : outer_var(pass, expr->atom);
+        if (v < 0)
+            return false;
+        *out = local ? *local : pass->state[v];
+        return true;
+    }
+    case NODE_BINARY_EXPR:
+        break;
+    default:
+        return false;
+    }
+
+    AffineForm left, right;
+    if (!form_of(pass, expr->left, &left) ||
+        !form_of(pass, expr->right, &right))
+        return false;
+
+    switch (expr->op)
+    {
+    case OP_ADD:
+        for (int d = 0; d < MAX_DIM; d++)
+            out->coef[d] = left.coef[d] + right.coef[d];
+        out->deferred = left.deferred || right.deferred;
+        return true;
+    case OP_SUB:
+        for (int d = 0; d < MAX_DIM; d++)
+            out->coef[d] = left.coef[d] - right.coef[d];
+        out->deferred = left.deferred || right.deferred;
+        return true;
+    case OP_MUL:
+        if (is_constant(&left))
+            scale_form(out, &right, left.coef[CONSTANT]);
+        else if (is_constant(&right))
+            scale_form(out, &left, right.coef[CONSTANT]);
+        else if (pass->collect)
+            defer(out);
+        else
+            return false;
+        return true;
+    case OP_SHL:
+        // The count's low five bits are all it uses (see arith.h)
+        if (is_constant(&right))
+            scale_form(out, &left,
+                       (uint32_t)1 << (right.coef[CONSTANT] & 31));
+        else if (pass->collect)
+            defer(out);
+        else
+            return false;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool run_statement(Pass *pass, const Node *stmt)
+{
+    AffineForm value;
+
+    if (stmt->type == NODE_VAR_DECL)
+    {
+        if (!stmt->left)
+            constant_form(&value, 0);
+        else if (!form_of(pass, stmt->left, &value))
+            return false;
+
+        // A second declaration in the body declares nothing
+        if (local_form(pass, stmt->atom))
+            return true;
+        if (pass->num_locals == AFFINE_MAX_LOCALS)
+            return false;
+        pass->local_atoms[pass->num_locals] = stmt->atom;
+        pass->locals[pass->num_locals] = value;
+        pass->num_locals++;
+        return true;
+    }
+    if (stmt->type != NODE_ASSIGNMENT)
+        return false;
+
+    // x op= e keeps "x op e" as its value
+    const Node *lhs = stmt->left;
+    if (!form_of(pass, lhs->right, &value))
+        return false;
+
+    AffineForm *local = local_form(pass, lhs->atom);
+    if (local)
+    {
+        *local = value;
+        return true;
+    }
+    int v = outer_var(pass, lhs->atom);
+    if (v < 0)
+        return false;
+    if (pass->collect)
+        pass->collect->assigned[v] = true;
+    pass->state[v] = value;
+    return true;
+}
+
+// One pass through the body, from pass->state to pass->state
+static bool run_body(Pass *pass)
+{
+    pass->num_locals = 0;
+    for (const Node *stmt = pass->loop->loop->left->left; stmt;
+         stmt = stmt->right)
+    {
+        if (!run_statement(pass, stmt))
+            return false;
+    }
+    return true;
+}
+
+static bool read_side(Pass *pass, const Node *expr, InductionOperand *out)
+{
+    out->is_var = expr->type == NODE_IDENTIFIER;
+    out->var = -1;
+    out->literal = 0;
+    if (expr->type == NODE_LITERAL_INT)
+        out->literal = expr->value.int_val;
+    else if (out->is_var)
+        out->var = outer_var(pass, expr->atom);
+    return out->is_var ? out->var >= 0 : expr->type == NODE_LITERAL_INT;
+}
+
+static bool unassigned(const AffineLoop *loop, const InductionOperand *side)
+{
+    return !side->is_var || !loop->assigned[side->var];
+}
+
+// The body's declarations are out of scope here: the condition only sees
+// names from outside it
+static bool read_condition(Pass *pass, const Node *condition)
+{
+    AffineLoop *loop = pass->collect;
+
+    if (condition->type == NODE_IDENTIFIER)
+    {
+        // while (i): i != 0
+        loop->control = outer_var(pass, condition->atom);
+        loop->relation = OP_NE;
+        loop->bound.is_var = false;
+        loop->bound.var = -1;
+        loop->bound.literal = 0;
+        return loop->control >= 0 && loop->assigned[loop->control];
+    }
+    if (condition->type != NODE_BINARY_EXPR)
+        return false;
+
+    OpKind relation = condition->op;
+    if (relation != OP_LT && relation != OP_LE && relation != OP_GT &&
+        relation != OP_GE && relation != OP_EQ && relation != OP_NE)
+        return false;
+
+    InductionOperand left, right;
+    if (!read_side(pass, condition->left, &left) ||
+        !read_side(pass, condition->right, &right))
+        return false;
+
+    // The counter goes left: n > i is i < n
+    if (left.is_var && !unassigned(loop, &left) && unassigned(loop, &right))
+    {
+        loop->control = left.var;
+        loop->relation = relation;
+        loop->bound = right;
+        return true;
+    }
+    if (right.is_var && !unassigned(loop, &right) && unassigned(loop, &left))
+    {
+        static const OpKind flipped[OP_COUNT] = {
+            [OP_LT] = OP_GT, [OP_LE] = OP_GE, [OP_GT] = OP_LT,
+            [OP_GE] = OP_LE, [OP_EQ] = OP_EQ, [OP_NE] = OP_NE};
+        loop->control = right.var;
+        loop->relation = flipped[relation];
+        loop->bound = left;
+        return true;
+    }
+    return false;
+}
+
+// Fewer passes than this are quicker run than raised (see AFFINE_MIN_TRIPS)
+static int64_t min_trips(const AffineLoop *loop)
+{
+    return (int64_t)AFFINE_MIN_TRIPS * loop->num_vars * loop->num_vars;
+}
+
+// The pass's matrix over (vars..., 1), from the forms the variables end
+// it with
+static void fill_matrix(const AffineLoop *loop, const AffineForm *state,
+                        Matrix out)
+{
+    int num_vars = loop->num_vars;
+    for (int v = 0; v < num_vars; v++)
+    {
+        for (int u = 0; u < num_vars; u++)
+            out[v][u] = state[v].coef[u];
+        out[v][num_vars] = state[v].coef[CONSTANT];
+    }
+    for (int u = 0; u < num_vars; u++)
+        out[num_vars][u] = 0;
+    out[num_vars][num_vars] = 1;
+}
+
+// The counter must move by the same amount on every pass: the assigned
+// variables other than itself can't be in its row
+static bool steps_alone(const AffineLoop *loop, const uint32_t *row)
+{
+    for (int v = 0; v < loop->num_vars; v++)
+    {
+        if (loop->assigned[v] && row[v] != (v == loop->control))
+            return false;
+    }
+    return true;
+}
+
+bool affine_analyse(const Node *loop, AffineLoop *out)
+{
+    out->loop = loop;
+    out->do_while = loop->type == NODE_DO_WHILE_STATEMENT;
+    out->num_vars = 0;
+    if (!loop->left->left)
+        return false;
+
+    Pass pass;
+    pass.loop = out;
+    pass.collect = out;
+    if (!run_body(&pass) || !read_condition(&pass, loop->left->right))
+        return false;
+
+    out->counter_known = !pass.state[out->control].deferred;
+    out->fixed = true;
+    for (int v = 0; v < out->num_vars; v++)
+    {
+        if (pass.state[v].deferred)
+            out->fixed = false;
+    }
+    fill_matrix(out, pass.state, out->pass);
+    if (out->counter_known && !steps_alone(out, out->pass[out->control]))
+        return false;
+
+    // A step that no unassigned variable goes into is the same every time
+    out->min_distance = 0;
+    const uint32_t *counter = out->pass[out->control];
+    for (int v = 0; v < out->num_vars; v++)
+    {
+        if (v != out->control && counter[v] != 0)
+            return true;
+    }
+    if (out->counter_known)
+    {
+        int64_t reach = min_trips(out) * (int32_t)counter[out->num_vars];
+        out->min_distance = reach < 0 ? -reach : reach;
+    }
+    return true;
+}
+
+// The pass's matrix for a body with deferred products, the unassigned
+// variables' values folded into the constant column
+static bool build_pass(const AffineLoop *loop, const uint32_t *start,
+                       Matrix out)
+{
+    Pass pass;
+    pass.loop = loop;
+    pass.collect = NULL;
+    for (int v = 0; v < loop->num_vars; v++)
+    {
+        if (loop->assigned[v])
+            unit_form(&pass.state[v], v);
+        else
+            constant_form(&pass.state[v], start[v]);
+    }
+    if (!run_body(&pass))
+        return false;
+    fill_matrix(loop, pass.state, out);
+    return steps_alone(loop, out[loop->control]);
+}
+
+// out = a * b over the first `dim` rows and columns; out is neither
+static void multiply(Matrix out, const Matrix a, const Matrix b, int dim)
+{
+    for (int i = 0; i < dim; i++)
+    {
+        for (int j = 0; j < dim; j++)
+        {
+            uint32_t sum = 0;
+            for (int k = 0; k < dim; k++)
+                sum += a[i][k] * b[k][j];
+            out[i][j] = sum;
+        }
+    }
+}
+
+// state = M^trips * state: the powers of M commute, so each one that trips
+// has a bit for can be applied as soon as it is squared up. The squares
+// take turns in two scratch matrices, and the state in the two halves of
+// `states`, so nothing is copied on the way.
+static void raise_pass(const Matrix pass, int dim, int64_t trips,
+                       uint32_t *state)
+{
+    Matrix scratch[2];
+    const uint32_t(*power)[MAX_DIM] = pass;
+    uint32_t states[2][MAX_DIM];
+    memcpy(states[0], state, (size_t)dim * sizeof(uint32_t));
+    int current = 0;
+    for (int64_t rest = trips; rest > 0; rest >>= 1)
+    {
+        if (rest & 1)
+        {
+            const uint32_t *from = states[current];
+            uint32_t *to = states[!current];
+            for (int i = 0; i < dim; i++)
+            {
+                uint32_t sum = 0;
+                for (int k = 0; k < dim; k++)
+                    sum += power[i][k] * from[k];
+                to[i] = sum;
+            }
+            current = !current;
+        }
+        if (rest > 1)
+        {
+            uint32_t(*square)[MAX_DIM] =
+                power == scratch[0] ? scratch[1] : scratch[0];
+            multiply(square, power, power, dim);
+            power = square;
+        }
+    }
+    memcpy(state, states[current], (size_t)dim * sizeof(uint32_t));
+}
+
+bool affine_run(const AffineLoop *loop, int *const *values,
+                int *iterations_out)
+{
+    int num_vars = loop->num_vars;
+    int dim = num_vars + 1;
+    uint32_t state[MAX_DIM];
+    for (int v = 0; v < num_vars; v++)
+        state[v] = (uint32_t)*values[v];
+    state[num_vars] = 1;
+
+    int start = (int)state[loop->control];
+    int bound = loop->bound.is_var ? (int)state[loop->bound.var]
+                                   : loop->bound.literal;
+    if (affine_too_short(loop, start, bound))
+        return false;
+
+    Matrix built;
+    bool is_built = !loop->counter_known;
+    if (is_built && !build_pass(loop, state, built))
+        return false;
+
+    // The counter's step is the rest of its row applied to the start
+    const uint32_t *counter = is_built ? built[loop->control]
+                                       : loop->pass[loop->control];
+    uint32_t step = 0;
+    for (int d = 0; d < dim; d++)
+    {
+        if (d != loop->control)
+            step += counter[d] * state[d];
+    }
+
+    // Working out the trip count divides, which costs more than a short
+    // loop's passes: a counter that few steps from its bound runs the
+    // loop's own code straight away
+    int64_t distance = (int64_t)bound - start;
+    int64_t reach = min_trips(loop) * (int32_t)step;
+    if ((distance < 0 ? -distance : distance) < (reach < 0 ? -reach : reach))
+        return false;
+
+    int64_t trips;
+    if (!induction_trip_count(STEP_ADD, (int32_t)step, loop->do_while,
+                              loop->relation, start, bound, &trips))
+        return false;
+    if (trips < min_trips(loop))
+        return false;
+
+    if (!is_built && !loop->fixed)
+    {
+        if (!build_pass(loop, state, built))
+            return false;
+        is_built = true;
+    }
+    raise_pass(is_built ? built : loop->pass, dim, trips, state);
+
+    for (int v = 0; v < num_vars; v++)
+    {
+        if (loop->assigned[v])
+            *values[v] = (int)state[v];
+    }
+    *iterations_out = (int)trips;
+    return true;
+}
+
+// What a counter is stepped by when the body's only statement about its
+// name adds or takes a literal (i += 2, i = i - 1); 0 otherwise
+static int32_t literal_step(const Node *body, Atom atom)
+{
+    int32_t step = 0;
+    for (const Node *stmt = body; stmt; stmt = stmt->right)
+    {
+        // A body local of the same name is a different variable
+        if (stmt->type == NODE_VAR_DECL && stmt->atom == atom)
+            return 0;
+        if (stmt->type != NODE_ASSIGNMENT || stmt->left->atom != atom)
+            continue;
+
+        const Node *value = stmt->left->right;
+        if (step != 0 || value->type != NODE_BINARY_EXPR ||
+            (value->op != OP_ADD && value->op != OP_SUB) ||
+            value->left->type != NODE_IDENTIFIER ||
+            value->left->atom != atom ||
+            value->right->type != NODE_LITERAL_INT)
+            return 0;
+        step = value->right->value.int_val;
+        if (value->op == OP_SUB)
+            step = (int32_t)(0u - (uint32_t)step);
+    }
+    return step;
+}
+
+// The tree evaluator analyses a loop each time it starts it, which costs
+// more than a few passes. When the counter's step is a literal, a loop too
+// short for the matrix can be told from the values in scope first; the
+// loop has at least as many variables as its condition names.
+static bool plainly_short(const Node *loop, ScopeStack *scope_stack)
+{
+    const Node *condition = loop->left->right;
+    const Node *sides[2] = {condition, NULL};
+    if (condition->type == NODE_BINARY_EXPR)
+    {
+        sides[0] = condition->left;
+        sides[1] = condition->right;
+    }
+    else if (condition->type != NODE_IDENTIFIER)
+        return false;
+
+    for (int s = 0; s < 2; s++)
+    {
+        const Node *counter = sides[s];
+        const Node *other = sides[!s];
+        if (!counter || counter->type != NODE_IDENTIFIER)
+            continue;
+        int32_t step = literal_step(loop->left->left, counter->atom);
+        if (step == 0)
+            continue;
+
+        int names = 1;
+        int bound = 0;
+        if (other && other->type == NODE_IDENTIFIER)
+        {
+            Symbol *sym = find_symbol_in_scope_stack(scope_stack,
+                                                     other->atom);
+            if (!sym)
+                return false;
+            bound = sym->value;
+            names = 2;
+        }
+        else if (other && other->type == NODE_LITERAL_INT)
+            bound = other->value.int_val;
+        else if (other)
+            return false;
+
+        Symbol *sym = find_symbol_in_scope_stack(scope_stack, counter->atom);
+        if (!sym)
+            return false;
+        int64_t distance = (int64_t)bound - sym->value;
+        int64_t reach = (int64_t)AFFINE_MIN_TRIPS * names * names * step;
+        return (distance < 0 ? -distance : distance) <
+               (reach < 0 ? -reach : reach);
+    }
+    return false;
+}
+
+bool affine_run_loop(const Node *loop, ScopeStack *scope_stack,
+                     int *iterations_out)
+{
+    if (plainly_short(loop, scope_stack))
+        return false;
+
+    AffineLoop affine;
+    if (!affine_analyse(loop, &affine))
+        return false;
+
+    int *values[AFFINE_MAX_VARS];
+    for (int v = 0; v < affine.num_vars; v++)
+    {
+        Symbol *sym = find_symbol_in_scope_stack(scope_stack,
+                                                 affine.vars[v]);
+        if (!sym)
+            return false; // the evaluator reports it
+        values[v] = &sym->value;
+    }
+    return affine_run(&affine, values, iterations_out);
+}
@@ -0,0 +1,78 @@
+#ifndef AFFINE_H
+// "If AFFINE_H is not defined yet..."
+#define AFFINE_H
+// "...define it now."
+
+#include "induction.h"
+
+// Build with -DLOOP_AFFINE=0 to run affine loops iteration by iteration
+// like any other.
+#ifndef LOOP_AFFINE
+#define LOOP_AFFINE 1
+#endif
+
+// Most variables from outside its body one affine loop may use, and most
+// declarations in the body
+#define AFFINE_MAX_VARS 16
+#define AFFINE_MAX_LOCALS 16
+
+// A loop of fewer passes than this times the square of its variable count
+// runs its own code: a pass costs about a row of the matrix, and each of
+// the O(log N) products a whole matrix's worth of rows
+#ifndef AFFINE_MIN_TRIPS
+#define AFFINE_MIN_TRIPS 8
+#endif
+
+// A loop whose body maps the variables it assigns to sums of multiples of
+// one another plus a constant (t = x + y; x = y; y = t; i += 1), and whose
+// condition tests a counter: one variable that every pass steps by the
+// same amount, against a bound the loop leaves alone. N passes are then
+// the N-th power of the body's matrix, which takes O(log N) products.
+typedef struct
+{
+    const Node *loop; // the syntax tree, read again by affine_run
+    bool do_while;
+    Atom vars[AFFINE_MAX_VARS]; // names from outside the body
+    bool assigned[AFFINE_MAX_VARS];
+    int num_vars;
+    int control;     // the counter
+    OpKind relation; // condition: control relation bound
+    InductionOperand bound;
+    // One pass over (vars..., 1). Only its rows with no product by a name
+    // the body never assigns are built here; the rest wait for the values.
+    uint32_t pass[AFFINE_MAX_VARS + 1][AFFINE_MAX_VARS + 1];
+    bool fixed;         // every row is
+    bool counter_known; // the counter's row is
+    // How far from its bound the counter must start for the matrix to pay
+    // (see AFFINE_MIN_TRIPS); 0 if its step is only known at run time
+    int64_t min_distance;
+} AffineLoop;
+
+// Recognise an affine loop in the syntax tree the parser reads loops into;
+// false if `loop` is any other kind. `loop` must outlive `out`.
+bool affine_analyse(const Node *loop, AffineLoop *out);
+
+// Run `loop` to the end in one step: values[i] is where vars[i] lives.
+// Returns false, having changed nothing, if a product turns out not to
+// have a constant side, or the trip count can't be worked out (see
+// induction_trip_count) or is too small to pay for the matrix (see
+// AFFINE_MIN_TRIPS); otherwise *iterations_out is the number of times the
+// body ran. Arithmetic wraps at 32 bits, as the evaluator's does.
+bool affine_run(const AffineLoop *loop, int *const *values,
+                int *iterations_out);
+
+// Whether a loop whose counter starts at `start`, against `bound`, is too
+// short for affine_run to take; cheap enough to test before calling it
+static inline bool affine_too_short(const AffineLoop *loop, int start,
+                                    int bound)
+{
+    int64_t distance = (int64_t)bound - start;
+    return (distance < 0 ? -distance : distance) < loop->min_distance;
+}
+
+// Both steps for a loop whose variables are all in `scope_stack`, as
+// vm_run_loop takes it
+bool affine_run_loop(const Node *loop, ScopeStack *scope_stack,
+                     int *iterations_out);
+
+#endif // AFFINE_H
@@ -0,0 +1,387 @@
+#include "induction.h"
+
+// Loops like `while (b) { b >>= 1; d <<= 1; }`: the body is a list of
+// assignments that each move one variable by a loop invariant, so after n
+// iterations every variable is a closed-form function of n and its value
+// on entry. Only the trip count n needs working out, from the condition's
+// variable alone: arithmetically when it is added to, by stepping it when
+// it is shifted or set (at most 33 shifts reach a fixed point).
+//
+// Results are what the evaluator computes one step at a time with the
+// language's int arithmetic (see arith.h): sums wrap at 32 bits, a left
+// shift keeps the low 32 bits, and a shift count's low five bits are all
+// it uses.
+
+#define SIMULATE_LIMIT 64
+
+static int var_index(InductionLoop *loop, Atom atom)
+{
+    for (int v = 0; v < loop->num_vars; v++)
+    {
+        if (loop->vars[v].atom == atom)
+            return v;
+    }
+    if (loop->num_vars == INDUCTION_MAX_VARS)
+        return -1;
+
+    InductionVar *var = &loop->vars[loop->num_vars];
+    var->atom = atom;
+    var->step = STEP_NONE;
+    var->amount.is_var = false;
+    var->amount.var = -1;
+    var->amount.literal = 0;
+    return loop->num_vars++;
+}
+
+static bool read_operand(InductionLoop *loop, const Node *expr,
+                         InductionOperand *out)
+{
+    out->is_var = false;
+    out->var = -1;
+    out->literal = 0;
+
+    if (expr->type == NODE_LITERAL_INT)
+    {
+        out->literal = expr->value.int_val;
+        return true;
+    }
+    if (expr->type != NODE_IDENTIFIER)
+        return false;
+
+    out->is_var = true;
+    out->var = var_index(loop, expr->atom);
+    return out->var >= 0;
+}
+
+static bool invariant(const InductionLoop *loop,
+                      const InductionOperand *operand)
+{
+    return !operand->is_var || loop->vars[operand->var].step == STEP_NONE;
+}
+
+static bool read_step(InductionLoop *loop, const Node *stmt)
+{
+    if (stmt->type != NODE_ASSIGNMENT)
+        return false;
+
+    const Node *lhs = stmt->left;
+    const Node *value = lhs->right;
+    StepKind step;
+    switch (stmt->op)
+    {
+    case OP_ASSIGN:
+        step = STEP_SET;
+        break;
+    case OP_ADD_ASSIGN:
+        step = STEP_ADD;
+        break;
+    case OP_SUB_ASSIGN:
+        step = STEP_SUB;
+        break;
+    case OP_SHL_ASSIGN:
+        step = STEP_SHL;
+        break;
+    case OP_SHR_ASSIGN:
+        step = STEP_SHR;
+        break;
+    default:
+        return false;
+    }
+
+    // x op= e keeps "x op e" as its value
+    const Node *amount = step == STEP_SET ? value : value->right;
+    int target = var_index(loop, lhs->atom);
+    if (target < 0 || loop->vars[target].step != STEP_NONE)
+        return false;
+    if (!read_operand(loop, amount, &loop->vars[target].amount))
+        return false;
+    loop->vars[target].step = step;
+    return true;
+}
+
+static OpKind flipped(OpKind relation)
+{
+    switch (relation)
+    {
+    case OP_LT:
+        return OP_GT;
+    case OP_LE:
+        return OP_GE;
+    case OP_GT:
+        return OP_LT;
+    case OP_GE:
+        return OP_LE;
+    default:
+        return relation; // == and !=
+    }
+}
+
+static bool read_condition(InductionLoop *loop, const Node *condition)
+{
+    if (condition->type == NODE_IDENTIFIER)
+    {
+        // while (x): x != 0
+        loop->control = var_index(loop, condition->atom);
+        loop->relation = OP_NE;
+        loop->bound.is_var = false;
+        loop->bound.var = -1;
+        loop->bound.literal = 0;
+        return loop->control >= 0;
+    }
+    if (condition->type != NODE_BINARY_EXPR)
+        return false;
+
+    OpKind relation = condition->op;
+    if (relation != OP_LT && relation != OP_LE && relation != OP_GT &&
+        relation != OP_GE && relation != OP_EQ && relation != OP_NE)
+        return false;
+
+    InductionOperand left, right;
+    if (!read_operand(loop, condition->left, &left) ||
+        !read_operand(loop, condition->right, &right))
+        return false;
+
+    // The variable side goes left: 10 > i is i < 10
+    if (left.is_var && invariant(loop, &right))
+    {
+        loop->control = left.var;
+        loop->relation = relation;
+        loop->bound = right;
+        return true;
+    }
+    if (right.is_var && invariant(loop, &left))
+    {
+        loop->control = right.var;
+        loop->relation = flipped(relation);
+        loop->bound = left;
+        return true;
+    }
+    return false;
+}
+
+bool induction_analyse(const Node *loop, InductionLoop *out)
+{
+    const Node *body = loop->left;
+    const Node *condition = body->right;
+
+    out->do_while = loop->type == NODE_DO_WHILE_STATEMENT;
+    out->num_vars = 0;
+    if (!body->left)
+        return false;
+
+    for (const Node *stmt = body->left; stmt; stmt = stmt->right)
+    {
+        if (!read_step(out, stmt))
+            return false;
+    }
+
+    // Amounts are read before the body runs, so none may be stepped
+    for (int v = 0; v < out->num_vars; v++)
+    {
+        if (!invariant(out, &out->vars[v].amount))
+            return false;
+    }
+    return read_condition(out, condition);
+}
+
+static int operand_value(const InductionOperand *operand, const int *start)
+{
+    return operand->is_var ? start[operand->var] : operand->literal;
+}
+
+static bool holds(OpKind relation, int64_t value, int64_t bound)
+{
+    switch (relation)
+    {
+    case OP_LT:
+        return value < bound;
+    case OP_LE:
+        return value <= bound;
+    case OP_GT:
+        return value > bound;
+    case OP_GE:
+        return value >= bound;
+    case OP_EQ:
+        return value == bound;
+    default:
+        return value != bound;
+    }
+}
+
+// `value` after one more pass, for the steps that are not sums
+static int stepped(StepKind step, int value, int amount)
+{
+    switch (step)
+    {
+    case STEP_SHL:
+        return (int)((uint32_t)value << amount);
+    case STEP_SHR:
+        return value >> amount;
+    case STEP_SET:
+        return amount;
+    default:
+        return value;
+    }
+}
+
+// Passes of the condition from `value` on, for a variable that moves by
+// `delta` each time; false if it never fails, or the variable would leave
+// the int range first (it would wrap around, and the test with it)
+static bool count_sum_passes(OpKind relation, int64_t value, int64_t delta,
+                             int64_t bound, int64_t *passes_out)
+{
+    int64_t passes;
+    if (!holds(relation, value, bound))
+        passes = 0;
+    else if (relation == OP_EQ)
+        passes = delta != 0 ? 1 : -1;
+    else if (relation == OP_NE)
+    {
+        int64_t distance = bound - value;
+        passes = delta != 0 && distance % delta == 0 && distance / delta > 0
+                     ? distance / delta
+                     : -1;
+    }
+    else if (relation == OP_LT || relation == OP_LE)
+    {
+        int64_t distance = bound - value + (relation == OP_LE);
+        passes = delta > 0 ? (distance + delta - 1) / delta : -1;
+    }
+    else
+    {
+        int64_t distance = value - bound + (relation == OP_GE);
+        passes = delta < 0 ? (distance - delta - 1) / -delta : -1;
+    }
+
+    if (passes < 0)
+        return false;
+    int64_t last = value + passes * delta;
+    if (last < INT32_MIN || last > INT32_MAX)
+        return false;
+    *passes_out = passes;
+    return true;
+}
+
+static bool count_passes(StepKind step, OpKind relation, int value,
+                         int amount, int bound, int64_t *passes_out)
+{
+    if (step == STEP_ADD || step == STEP_SUB)
+    {
+        int64_t delta = step == STEP_ADD ? amount : -(int64_t)amount;
+        return count_sum_passes(relation, value, delta, bound, passes_out);
+    }
+
+    for (int64_t passes = 0; passes < SIMULATE_LIMIT; passes++)
+    {
+        if (!holds(relation, value, bound))
+        {
+            *passes_out = passes;
+            return true;
+        }
+        value = stepped(step, value, amount);
+    }
+    return false; // at a fixed point that still passes: it never ends
+}
+
+// `value` after `trips` passes
+static int final_value(StepKind step, int value, int amount, int64_t trips)
+{
+    uint64_t total_shift = (uint64_t)trips * (uint64_t)amount;
+    switch (step)
+    {
+    case STEP_ADD:
+        return (int)((uint32_t)value + (uint32_t)trips * (uint32_t)amount);
+    case STEP_SUB:
+        return (int)((uint32_t)value - (uint32_t)trips * (uint32_t)amount);
+    case STEP_SHL:
+        return total_shift >= 32 ? 0 : (int)((uint32_t)value << total_shift);
+    case STEP_SHR:
+        return total_shift >= 31 ? (value < 0 ? -1 : 0)
+                                 : value >> total_shift;
+    case STEP_SET:
+        return trips > 0 ? amount : value;
+    default:
+        return value;
+    }
+}
+
+bool induction_trip_count(StepKind step, int amount, bool do_while,
+                          OpKind relation, int value, int bound,
+                          int64_t *trips_out)
+{
+    int64_t trips = 0;
+
+    // A do-while runs its body before the first test
+    if (do_while)
+    {
+        int64_t first = final_value(step, value, amount, 1);
+        if (step == STEP_ADD || step == STEP_SUB)
+        {
+            int64_t exact = step == STEP_ADD ? (int64_t)value + amount
+                                             : (int64_t)value - amount;
+            if (exact != first)
+                return false;
+        }
+        value = (int)first;
+        trips = 1;
+    }
+
+    int64_t passes;
+    if (!count_passes(step, relation, value, amount, bound, &passes))
+        return false;
+    trips += passes;
+    if (trips > INT32_MAX)
+        return false;
+    *trips_out = trips;
+    return true;
+}
+
+bool induction_run(const InductionLoop *loop, int *const *values,
+                   int *iterations_out)
+{
+    int start[INDUCTION_MAX_VARS];
+    int amounts[INDUCTION_MAX_VARS];
+    for (int v = 0; v < loop->num_vars; v++)
+        start[v] = *values[v];
+    for (int v = 0; v < loop->num_vars; v++)
+    {
+        const InductionVar *var = &loop->vars[v];
+        amounts[v] = operand_value(&var->amount, start);
+        if (var->step == STEP_SHL || var->step == STEP_SHR)
+            amounts[v] &= 31;
+    }
+
+    int64_t trips;
+    if (!induction_trip_count(loop->vars[loop->control].step,
+                              amounts[loop->control], loop->do_while,
+                              loop->relation, start[loop->control],
+                              operand_value(&loop->bound, start), &trips))
+        return false;
+
+    for (int v = 0; v < loop->num_vars; v++)
+    {
+        const InductionVar *var = &loop->vars[v];
+        *values[v] = final_value(var->step, start[v], amounts[v], trips);
+    }
+    *iterations_out = (int)trips;
+    return true;
+}
+
+bool induction_run_loop(const Node *loop, ScopeStack *scope_stack,
+                        int *iterations_out)
+{
+    InductionLoop induction;
+    if (!induction_analyse(loop, &induction))
+        return false;
+
+    int *values[INDUCTION_MAX_VARS];
+    for (int v = 0; v < induction.num_vars; v++)
+    {
+        Symbol *sym = find_symbol_in_scope_stack(scope_stack,
+                                                 induction.vars[v].atom);
+        if (!sym)
+            return false; // the evaluator reports it
+        values[v] = &sym->value;
+    }
+    return induction_run(&induction, values, iterations_out);
+}
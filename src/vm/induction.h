@@ -0,0 +1,81 @@
+#ifndef INDUCTION_H
+// "If INDUCTION_H is not defined yet..."
+#define INDUCTION_H
+// "...define it now."
+
+#include "../parser/parser.h"
+
+// Build with -DLOOP_INDUCTION=0 to run induction loops iteration by
+// iteration like any other.
+#ifndef LOOP_INDUCTION
+#define LOOP_INDUCTION 1
+#endif
+
+// Most variables one induction loop may read or write
+#define INDUCTION_MAX_VARS 16
+
+// What one pass through the body does to a variable
+typedef enum
+{
+    STEP_NONE, // not assigned: the same on every iteration
+    STEP_ADD,  // x += amount
+    STEP_SUB,  // x -= amount
+    STEP_SHL,  // x <<= amount
+    STEP_SHR,  // x >>= amount
+    STEP_SET   // x = amount
+} StepKind;
+
+// A literal, or a variable the loop never assigns
+typedef struct
+{
+    bool is_var;
+    int var; // index into InductionLoop.vars
+    int literal;
+} InductionOperand;
+
+typedef struct
+{
+    Atom atom;
+    StepKind step;
+    InductionOperand amount;
+} InductionVar;
+
+// A loop whose body only steps variables by loop invariants, each variable
+// at most once, and whose condition compares one variable with an
+// invariant. Its trip count and final state follow from the state it
+// starts in without running it.
+typedef struct
+{
+    bool do_while;
+    InductionVar vars[INDUCTION_MAX_VARS]; // every name the loop uses
+    int num_vars;
+    int control;     // the variable in the condition
+    OpKind relation; // condition: control relation bound
+    InductionOperand bound;
+} InductionLoop;
+
+// Recognise an induction loop in the syntax tree the parser reads loops
+// into; false if `loop` is any other kind
+bool induction_analyse(const Node *loop, InductionLoop *out);
+
+// Iterations of a loop tested with `control relation bound`, when every
+// pass steps control (`value` on entry) by `amount` and leaves `bound` be;
+// false if that can't be worked out without running it
+bool induction_trip_count(StepKind step, int amount, bool do_while,
+                          OpKind relation, int value, int bound,
+                          int64_t *trips_out);
+
+// Run `loop` to the end in one step. values[i] is where vars[i] lives.
+// Returns false, having changed nothing, when the trip count can't be
+// worked out from the current values (a bound the control variable steps
+// away from or past, a result that would overflow, a shift by 32 or
+// more); otherwise *iterations_out is the number of times the body ran.
+bool induction_run(const InductionLoop *loop, int *const *values,
+                   int *iterations_out);
+
+// Both steps for a loop whose variables are all in `scope_stack`, as
+// vm_run_loop takes it
+bool induction_run_loop(const Node *loop, ScopeStack *scope_stack,
+                        int *iterations_out);
+
+#endif // INDUCTION_H
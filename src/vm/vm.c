@@ -0,0 +1,778 @@
+#include "vm.h"
+#include "affine.h" // and induction.h
+#include "../parser/arith.h"
+
+// The loop comes in as the syntax tree parser.c reads loops into: under
+// if / else if / while / do the block, then the condition as its sibling;
+// an assignment's value as the sibling of its identifier, with the
+// operator as written in the assignment's op.
+//
+// The code does what the parser's evaluator would. A block whose if
+// condition is false still runs "inactive": its conditions and nested
+// loops run as usual, but nothing is declared or assigned. So a block
+// under an if is compiled twice, active and inactive. The inactive copy
+// keeps only what can still have an effect: control flow, and divisions
+// that may stop the compiler with an error.
+
+#define VM_MAX_CODE 65535
+// Temporaries are tagged with the top bit until the named registers are
+// all known; both kinds together must fit in 16 bits
+#define VM_MAX_REGISTERS 32767
+#define VM_TEMP 0x8000
+
+// Every opcode. The binary ones (ADD to MOD_KEEP) compute r[a] = r[b] op
+// r[c]; MOD_KEEP and DIV_KEEP are x %= y and x /= y, which leave x alone
+// when y is 0 rather than failing.
+#define VM_OPCODE_LIST(X)                                                   \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) X(SHL) X(SHR)                        \
+    X(LT) X(LE) X(GT) X(GE) X(EQ) X(NE)                                     \
+    X(BIT_AND) X(BIT_XOR) X(BIT_OR) X(AND) X(OR)                            \
+    X(DIV_KEEP) X(MOD_KEEP)                                                 \
+    X(MOVE)            /* r[a] = r[b] */                                    \
+    X(JUMP)            /* to b */                                           \
+    X(JUMP_IF_ZERO)    /* to b if r[a] == 0 */                              \
+    X(JUMP_IF_NONZERO) /* to b if r[a] != 0 */                              \
+    X(COUNT)           /* one more iteration of the outermost loop */      \
+    X(CLOSED_FORM)     /* see compile_closed_form */                       \
+    X(HALT)
+
+typedef enum
+{
+    VM_NONE,
+#define X(name) VM_##name,
+    VM_OPCODE_LIST(X)
+#undef X
+    VM_OPCODE_COUNT
+} VmOpcode;
+
+typedef struct
+{
+    uint16_t op;
+    uint16_t a; // destination, or the register a conditional jump tests
+    uint16_t b; // first operand, or a jump's target
+    uint16_t c; // second operand
+} VmInstruction;
+
+static const uint8_t binary_opcode[OP_COUNT] = {
+    [OP_ADD] = VM_ADD,
+    [OP_SUB] = VM_SUB,
+    [OP_MUL] = VM_MUL,
+    [OP_DIV] = VM_DIV,
+    [OP_MOD] = VM_MOD,
+    [OP_SHL] = VM_SHL,
+    [OP_SHR] = VM_SHR,
+    [OP_LT] = VM_LT,
+    [OP_LE] = VM_LE,
+    [OP_GT] = VM_GT,
+    [OP_GE] = VM_GE,
+    [OP_EQ] = VM_EQ,
+    [OP_NE] = VM_NE,
+    [OP_BIT_AND] = VM_BIT_AND,
+    [OP_BIT_XOR] = VM_BIT_XOR,
+    [OP_BIT_OR] = VM_BIT_OR,
+    [OP_AND] = VM_AND,
+    [OP_OR] = VM_OR,
+};
+
+typedef struct
+{
+    Atom atom;
+    uint16_t reg;
+} VmLocal;
+
+// A variable declared outside the loop: loaded into `reg` before the run
+// and stored back after it
+typedef struct
+{
+    Symbol *symbol;
+    uint16_t reg;
+} VmImport;
+
+#define VM_CLOSED_FORM_VARS                                                 \
+    (INDUCTION_MAX_VARS > AFFINE_MAX_VARS ? INDUCTION_MAX_VARS               \
+                                          : AFFINE_MAX_VARS)
+
+// A loop that can be run in one step (see induction.h and affine.h) and
+// the registers of its variables
+typedef struct
+{
+    bool affine; // else an induction loop
+    InductionLoop induction;
+    AffineLoop affine_loop;
+    int num_vars;
+    uint16_t registers[VM_CLOSED_FORM_VARS];
+} VmClosedForm;
+
+typedef struct
+{
+    ScopeStack *scope_stack;
+    VmInstruction *code;
+    size_t length;
+    size_t code_capacity;
+    int *initial; // starting value of each named register
+    size_t num_named;
+    size_t named_capacity;
+    size_t num_temps; // in use by the statement being compiled
+    size_t max_temps;
+    VmLocal *locals; // declarations in scope, innermost last
+    size_t num_locals;
+    size_t locals_capacity;
+    size_t scope_start; // first local of the innermost block
+    VmImport *imports;
+    size_t num_imports;
+    size_t imports_capacity;
+    VmClosedForm *closed_forms;
+    size_t num_closed_forms;
+    size_t closed_forms_capacity;
+    uint16_t zero;
+    uint16_t one;
+    bool failed; // leave the loop to the tree evaluator
+} VmCompiler;
+
+static void *grow_array(void *array, size_t *capacity, size_t element_size)
+{
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    void *grown = realloc(array, new_capacity * element_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Memory allocation failed in loop compiler\n");
+        exit(EXIT_FAILURE);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+// Index of the new instruction, for patching a jump target later
+static size_t emit(VmCompiler *c, VmOpcode op, uint16_t a, uint16_t b,
+                   uint16_t operand)
+{
+    if (c->failed || c->length >= VM_MAX_CODE)
+    {
+        c->failed = true;
+        return 0;
+    }
+    if (c->length >= c->code_capacity)
+        c->code = grow_array(c->code, &c->code_capacity,
+                             sizeof(VmInstruction));
+
+    VmInstruction *instruction = &c->code[c->length];
+    instruction->op = (uint16_t)op;
+    instruction->a = a;
+    instruction->b = b;
+    instruction->c = operand;
+    return c->length++;
+}
+
+// Point the jump at `at` to the next instruction emitted
+static void patch_jump(VmCompiler *c, size_t at)
+{
+    if (!c->failed)
+        c->code[at].b = (uint16_t)c->length;
+}
+
+static uint16_t new_register(VmCompiler *c, int initial)
+{
+    if (c->num_named >= VM_MAX_REGISTERS)
+    {
+        c->failed = true;
+        return 0;
+    }
+    if (c->num_named >= c->named_capacity)
+        c->initial = grow_array(c->initial, &c->named_capacity, sizeof(int));
+    c->initial[c->num_named] = initial;
+    return (uint16_t)c->num_named++;
+}
+
+static uint16_t new_temp(VmCompiler *c)
+{
+    size_t temp = c->num_temps++;
+    if (c->num_temps > c->max_temps)
+        c->max_temps = c->num_temps;
+    if (temp >= VM_MAX_REGISTERS)
+    {
+        c->failed = true;
+        return 0;
+    }
+    return (uint16_t)(VM_TEMP | temp);
+}
+
+// Register of the variable `name` refers to where it is used: a local of
+// the loop, or a symbol from outside it
+static uint16_t variable_register(VmCompiler *c, Atom name)
+{
+    for (size_t l = c->num_locals; l-- > 0;)
+    {
+        if (c->locals[l].atom == name)
+            return c->locals[l].reg;
+    }
+
+    Symbol *sym = find_symbol_in_scope_stack(c->scope_stack, name);
+    if (!sym)
+    {
+        // Undefined: the evaluator reports it, if the code is reached
+        c->failed = true;
+        return 0;
+    }
+    for (size_t i = 0; i < c->num_imports; i++)
+    {
+        if (c->imports[i].symbol == sym)
+            return c->imports[i].reg;
+    }
+
+    if (c->num_imports >= c->imports_capacity)
+        c->imports = grow_array(c->imports, &c->imports_capacity,
+                                sizeof(VmImport));
+    VmImport *import = &c->imports[c->num_imports++];
+    import->symbol = sym;
+    import->reg = new_register(c, 0);
+    return import->reg;
+}
+
+static void declare_local(VmCompiler *c, Atom atom, uint16_t reg)
+{
+    if (c->num_locals >= c->locals_capacity)
+        c->locals = grow_array(c->locals, &c->locals_capacity,
+                               sizeof(VmLocal));
+    c->locals[c->num_locals].atom = atom;
+    c->locals[c->num_locals].reg = reg;
+    c->num_locals++;
+}
+
+static VmOpcode expression_opcode(VmCompiler *c, OpKind op)
+{
+    VmOpcode opcode = op < OP_COUNT ? binary_opcode[op] : VM_NONE;
+    if (opcode == VM_NONE)
+        c->failed = true;
+    return opcode;
+}
+
+// Register holding the value of `expr` once the code emitted for it ran
+static uint16_t compile_expression(VmCompiler *c, const Node *expr)
+{
+    switch (expr->type)
+    {
+    case NODE_LITERAL_INT:
+        return new_register(c, expr->value.int_val);
+    case NODE_IDENTIFIER:
+        return variable_register(c, expr->atom);
+    case NODE_BINARY_EXPR:
+    {
+        uint16_t left = compile_expression(c, expr->left);
+        uint16_t right = compile_expression(c, expr->right);
+        uint16_t result = new_temp(c);
+        emit(c, expression_opcode(c, expr->op), result, left, right);
+        return result;
+    }
+    default:
+        c->failed = true;
+        return 0;
+    }
+}
+
+// The same, with the result left in `dest`. The last instruction reads
+// its operands before writing, so `dest` may be one of them (x = x + 1).
+static void compile_expression_into(VmCompiler *c, const Node *expr,
+                                    uint16_t dest)
+{
+    if (expr->type != NODE_BINARY_EXPR)
+    {
+        emit(c, VM_MOVE, dest, compile_expression(c, expr), 0);
+        return;
+    }
+
+    uint16_t left = compile_expression(c, expr->left);
+    uint16_t right = compile_expression(c, expr->right);
+    emit(c, expression_opcode(c, expr->op), dest, left, right);
+}
+
+static bool may_fail(const Node *expr)
+{
+    if (expr->type != NODE_BINARY_EXPR)
+        return false;
+    return expr->op == OP_DIV || expr->op == OP_MOD ||
+           may_fail(expr->left) || may_fail(expr->right);
+}
+
+static void resolve_names(VmCompiler *c, const Node *expr)
+{
+    if (expr->type == NODE_IDENTIFIER)
+        variable_register(c, expr->atom);
+    else if (expr->type == NODE_BINARY_EXPR)
+    {
+        resolve_names(c, expr->left);
+        resolve_names(c, expr->right);
+    }
+}
+
+// An expression whose value goes nowhere: only a zero divisor can still
+// make a difference. Its names must resolve all the same.
+static void compile_discarded(VmCompiler *c, const Node *expr)
+{
+    if (may_fail(expr))
+        compile_expression(c, expr);
+    else
+        resolve_names(c, expr);
+}
+
+static void compile_block(VmCompiler *c, const Node *block, bool active);
+static void compile_loop(VmCompiler *c, const Node *loop, bool count);
+
+// `block` active, unless one of the `num_jumps` jumps at `to_inactive` is
+// taken: then inactive
+static void compile_branches(VmCompiler *c, const Node *block,
+                             const size_t *to_inactive, int num_jumps)
+{
+    compile_block(c, block, true);
+    size_t past_inactive = emit(c, VM_JUMP, 0, 0, 0);
+    size_t inactive_start = c->length;
+    compile_block(c, block, false);
+
+    // Nothing to do when inactive: drop the jump over it
+    bool nothing_inactive = !c->failed && c->length == inactive_start;
+    if (nothing_inactive)
+        c->length--;
+    else
+        patch_jump(c, past_inactive);
+
+    if (c->failed)
+        return;
+    size_t target = nothing_inactive ? c->length : inactive_start;
+    for (int j = 0; j < num_jumps; j++)
+        c->code[to_inactive[j]].b = (uint16_t)target;
+}
+
+static bool continues_chain(const Node *next)
+{
+    return next && (next->type == NODE_ELSE_IF_STATEMENT ||
+                    next->type == NODE_ELSE_STATEMENT);
+}
+
+// `chain` holds "some condition of this if chain was true" at run time
+static void compile_statement(VmCompiler *c, const Node *stmt, bool active,
+                              uint16_t *chain)
+{
+    switch (stmt->type)
+    {
+    case NODE_VAR_DECL:
+    {
+        // A second declaration in the same block declares nothing
+        bool redeclared = false;
+        for (size_t l = c->scope_start; l < c->num_locals; l++)
+        {
+            if (c->locals[l].atom == stmt->atom)
+                redeclared = true;
+        }
+
+        if (!active || redeclared)
+        {
+            if (stmt->left)
+                compile_discarded(c, stmt->left);
+            break;
+        }
+
+        // The initialiser still sees any outer variable of the same name
+        uint16_t reg = new_register(c, 0);
+        if (stmt->left)
+            compile_expression_into(c, stmt->left, reg);
+        else
+            emit(c, VM_MOVE, reg, c->zero, 0);
+        declare_local(c, stmt->atom, reg);
+        break;
+    }
+    case NODE_ASSIGNMENT:
+    {
+        const Node *lhs = stmt->left;
+        const Node *value = lhs->right;
+        uint16_t target = variable_register(c, lhs->atom);
+
+        if (stmt->op == OP_ASSIGN)
+        {
+            if (active)
+                compile_expression_into(c, value, target);
+            else
+                compile_discarded(c, value);
+        }
+        else if (!active)
+        {
+            compile_discarded(c, value->right);
+        }
+        else
+        {
+            OpKind op = value->op;
+            VmOpcode opcode = op == OP_DIV   ? VM_DIV_KEEP
+                              : op == OP_MOD ? VM_MOD_KEEP
+                                             : expression_opcode(c, op);
+            uint16_t rhs = compile_expression(c, value->right);
+            emit(c, opcode, target, target, rhs);
+        }
+        break;
+    }
+    case NODE_EXIT_CALL:
+        // Evaluated, and nothing more, until codegen
+        compile_discarded(c, stmt->left);
+        break;
+    case NODE_IF_STATEMENT:
+    case NODE_ELSE_IF_STATEMENT:
+    {
+        const Node *block = stmt->left;
+        uint16_t condition = compile_expression(c, block->right);
+        size_t to_inactive[2];
+        int num_jumps = 0;
+
+        if (stmt->type == NODE_ELSE_IF_STATEMENT)
+        {
+            to_inactive[num_jumps++] = emit(c, VM_JUMP_IF_NONZERO, *chain,
+                                            0, 0);
+        }
+        else if (continues_chain(stmt->right))
+        {
+            *chain = new_register(c, 0);
+            emit(c, VM_NE, *chain, condition, c->zero);
+        }
+        to_inactive[num_jumps++] = emit(c, VM_JUMP_IF_ZERO, condition, 0, 0);
+        if (stmt->type == NODE_ELSE_IF_STATEMENT &&
+            continues_chain(stmt->right))
+        {
+            emit(c, VM_MOVE, *chain, c->one, 0);
+        }
+        compile_branches(c, block, to_inactive, num_jumps);
+        break;
+    }
+    case NODE_ELSE_STATEMENT:
+    {
+        size_t to_inactive = emit(c, VM_JUMP_IF_NONZERO, *chain, 0, 0);
+        compile_branches(c, stmt->left, &to_inactive, 1);
+        break;
+    }
+    case NODE_WHILE_STATEMENT:
+    case NODE_DO_WHILE_STATEMENT:
+        // Loops run whether or not the enclosing block is active
+        compile_loop(c, stmt, false);
+        break;
+    case NODE_BLOCK:
+        compile_block(c, stmt, active);
+        break;
+    default:
+        c->failed = true;
+        break;
+    }
+}
+
+static void compile_block(VmCompiler *c, const Node *block, bool active)
+{
+    size_t outer_start = c->scope_start;
+    size_t outer_locals = c->num_locals;
+    c->scope_start = c->num_locals;
+
+    uint16_t chain = 0;
+    for (const Node *stmt = block->left; stmt && !c->failed;
+         stmt = stmt->right)
+    {
+        // Temporaries never outlive the statement that made them
+        c->num_temps = 0;
+        compile_statement(c, stmt, active, &chain);
+    }
+
+    c->num_locals = outer_locals;
+    c->scope_start = outer_start;
+}
+
+// CLOSED_FORM a, b, c runs loop a to the end in one step and jumps to b,
+// adding the iterations to the count if c is set. When the trip count
+// can't be had, or is too small to be worth it, it falls through to the
+// loop's own code.
+static bool compile_closed_form(VmCompiler *c, const Node *loop, bool count,
+                                size_t *at_out)
+{
+    if (c->num_closed_forms >= UINT16_MAX)
+        return false;
+    if (c->num_closed_forms >= c->closed_forms_capacity)
+        c->closed_forms = grow_array(c->closed_forms,
+                                     &c->closed_forms_capacity,
+                                     sizeof(VmClosedForm));
+
+    VmClosedForm *entry = &c->closed_forms[c->num_closed_forms];
+    if (LOOP_INDUCTION && induction_analyse(loop, &entry->induction))
+    {
+        entry->affine = false;
+        entry->num_vars = entry->induction.num_vars;
+        for (int v = 0; v < entry->num_vars; v++)
+            entry->registers[v] =
+                variable_register(c, entry->induction.vars[v].atom);
+    }
+    else if (LOOP_AFFINE && affine_analyse(loop, &entry->affine_loop))
+    {
+        entry->affine = true;
+        entry->num_vars = entry->affine_loop.num_vars;
+        for (int v = 0; v < entry->num_vars; v++)
+            entry->registers[v] =
+                variable_register(c, entry->affine_loop.vars[v]);
+    }
+    else
+        return false;
+
+    *at_out = emit(c, VM_CLOSED_FORM, (uint16_t)c->num_closed_forms++, 0,
+                   count);
+    return true;
+}
+
+// Rotated: the condition is tested after the body, and once before the
+// first iteration of a while loop
+static void compile_loop(VmCompiler *c, const Node *loop, bool count)
+{
+    const Node *body = loop->left;
+    const Node *condition = body->right;
+
+    size_t closed_form = 0;
+    bool has_closed_form = compile_closed_form(c, loop, count, &closed_form);
+
+    size_t skip_loop = 0;
+    bool is_while = loop->type == NODE_WHILE_STATEMENT;
+    if (is_while)
+    {
+        c->num_temps = 0;
+        uint16_t first = compile_expression(c, condition);
+        skip_loop = emit(c, VM_JUMP_IF_ZERO, first, 0, 0);
+    }
+
+    size_t top = c->length;
+    compile_block(c, body, true);
+    if (count)
+        emit(c, VM_COUNT, 0, 0, 0);
+
+    c->num_temps = 0;
+    uint16_t again = compile_expression(c, condition);
+    emit(c, VM_JUMP_IF_NONZERO, again, (uint16_t)top, 0);
+
+    if (is_while)
+        patch_jump(c, skip_loop);
+    if (has_closed_form)
+        patch_jump(c, closed_form);
+}
+
+// Temporaries go after the named registers
+static void place_temps(VmCompiler *c)
+{
+    uint16_t base = (uint16_t)c->num_named;
+
+    for (size_t at = 0; at < c->length; at++)
+    {
+        VmInstruction *instruction = &c->code[at];
+        switch (instruction->op)
+        {
+        case VM_JUMP:
+        case VM_COUNT:
+        case VM_CLOSED_FORM:
+        case VM_HALT:
+            continue;
+        case VM_JUMP_IF_ZERO:
+        case VM_JUMP_IF_NONZERO:
+            if (instruction->a & VM_TEMP)
+                instruction->a = base + (instruction->a & ~VM_TEMP);
+            continue;
+        default:
+            break;
+        }
+        if (instruction->a & VM_TEMP)
+            instruction->a = base + (instruction->a & ~VM_TEMP);
+        if (instruction->b & VM_TEMP)
+            instruction->b = base + (instruction->b & ~VM_TEMP);
+        if (instruction->c & VM_TEMP)
+            instruction->c = base + (instruction->c & ~VM_TEMP);
+    }
+}
+
+// Threaded dispatch: every handler ends in a jump straight to the next
+// one's label (a GNU C extension), which predicts far better than one
+// shared switch. Other compilers get the same handlers in a switch.
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+// Times the outermost loop's body ran (see VM_COUNT)
+static int vm_execute(const VmInstruction *code,
+                      const VmClosedForm *closed_forms, int *r)
+{
+    const VmInstruction *pc = code;
+    int iterations = 0;
+
+#if VM_THREADED
+    static void *const handlers[VM_OPCODE_COUNT] = {
+#define X(name) [VM_##name] = &&do_##name,
+        VM_OPCODE_LIST(X)
+#undef X
+    };
+#define HANDLER(name) do_##name
+#define NEXT() goto *handlers[pc->op]
+    NEXT();
+#else
+#define HANDLER(name) case VM_##name
+#define NEXT() continue
+    for (;;)
+    {
+        switch (pc->op)
+        {
+#endif
+
+#define BINARY(name, expression)        \
+    HANDLER(name) :                     \
+    {                                   \
+        int x = r[pc->b];               \
+        int y = r[pc->c];               \
+        r[pc->a] = (expression);        \
+        pc++;                           \
+        NEXT();                         \
+    }
+
+    BINARY(ADD, arith_add(x, y))
+    BINARY(SUB, arith_sub(x, y))
+    BINARY(MUL, arith_mul(x, y))
+    BINARY(SHL, arith_shl(x, y))
+    BINARY(SHR, arith_shr(x, y))
+    BINARY(LT, x < y)
+    BINARY(LE, x <= y)
+    BINARY(GT, x > y)
+    BINARY(GE, x >= y)
+    BINARY(EQ, x == y)
+    BINARY(NE, x != y)
+    BINARY(BIT_AND, x & y)
+    BINARY(BIT_XOR, x ^ y)
+    BINARY(BIT_OR, x | y)
+    BINARY(AND, x && y)
+    BINARY(OR, x || y)
+    BINARY(DIV_KEEP, y != 0 ? arith_div(x, y) : x)
+    BINARY(MOD_KEEP, y != 0 ? arith_mod(x, y) : x)
+
+    // Same messages as fold_binary
+    HANDLER(DIV) :
+        if (r[pc->c] == 0)
+        {
+            fprintf(stderr, "Error: Division by zero\n");
+            exit(1);
+        }
+        r[pc->a] = arith_div(r[pc->b], r[pc->c]);
+        pc++;
+        NEXT();
+    HANDLER(MOD) :
+        if (r[pc->c] == 0)
+        {
+            fprintf(stderr, "Error: Modulo by zero\n");
+            exit(1);
+        }
+        r[pc->a] = arith_mod(r[pc->b], r[pc->c]);
+        pc++;
+        NEXT();
+    HANDLER(MOVE) :
+        r[pc->a] = r[pc->b];
+        pc++;
+        NEXT();
+    HANDLER(JUMP) :
+        pc = code + pc->b;
+        NEXT();
+    HANDLER(JUMP_IF_ZERO) :
+        pc = r[pc->a] == 0 ? code + pc->b : pc + 1;
+        NEXT();
+    HANDLER(JUMP_IF_NONZERO) :
+        pc = r[pc->a] != 0 ? code + pc->b : pc + 1;
+        NEXT();
+    HANDLER(COUNT) :
+        iterations++;
+        pc++;
+        NEXT();
+    HANDLER(CLOSED_FORM) :
+    {
+        const VmClosedForm *form = &closed_forms[pc->a];
+        if (form->affine)
+        {
+            // Short ones are told from the counter without the call
+            const AffineLoop *loop = &form->affine_loop;
+            int bound = loop->bound.is_var
+                            ? r[form->registers[loop->bound.var]]
+                            : loop->bound.literal;
+            if (affine_too_short(loop, r[form->registers[loop->control]],
+                                 bound))
+            {
+                pc++;
+                NEXT();
+            }
+        }
+        int *values[VM_CLOSED_FORM_VARS];
+        for (int v = 0; v < form->num_vars; v++)
+            values[v] = &r[form->registers[v]];
+
+        int trips;
+        bool done = form->affine
+                        ? affine_run(&form->affine_loop, values, &trips)
+                        : induction_run(&form->induction, values, &trips);
+        if (done)
+        {
+            if (pc->c)
+                iterations += trips;
+            pc = code + pc->b;
+        }
+        else
+            pc++;
+        NEXT();
+    }
+    HANDLER(HALT) :
+        return iterations;
+
+#if !VM_THREADED
+        default:
+            return iterations;
+        }
+    }
+#endif
+#undef BINARY
+#undef NEXT
+#undef HANDLER
+}
+
+static void free_compiler(VmCompiler *c)
+{
+    free(c->code);
+    free(c->initial);
+    free(c->locals);
+    free(c->imports);
+    free(c->closed_forms);
+}
+
+bool vm_run_loop(const Node *loop, ScopeStack *scope_stack,
+                 int *iterations_out)
+{
+    VmCompiler c;
+    memset(&c, 0, sizeof(c));
+    c.scope_stack = scope_stack;
+    c.zero = new_register(&c, 0);
+    c.one = new_register(&c, 1);
+
+    compile_loop(&c, loop, true);
+    emit(&c, VM_HALT, 0, 0, 0);
+    if (c.failed || c.num_named + c.max_temps > VM_MAX_REGISTERS)
+    {
+        free_compiler(&c);
+        return false;
+    }
+    place_temps(&c);
+
+    int *registers = malloc((c.num_named + c.max_temps) * sizeof(int));
+    if (!registers)
+    {
+        fprintf(stderr, "Memory allocation failed in loop VM\n");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(registers, c.initial, c.num_named * sizeof(int));
+    for (size_t i = 0; i < c.num_imports; i++)
+        registers[c.imports[i].reg] = c.imports[i].symbol->value;
+
+    *iterations_out = vm_execute(c.code, c.closed_forms, registers);
+
+    for (size_t i = 0; i < c.num_imports; i++)
+        c.imports[i].symbol->value = registers[c.imports[i].reg];
+
+    free(registers);
+    free_compiler(&c);
+    return true;
+}
@@ -0,0 +1,27 @@
+#ifndef VM_H
+// "If VM_H is not defined yet..."
+#define VM_H
+// "...define it now."
+
+#include "../parser/parser.h"
+
+// Build with -DLOOP_VM=0 to run every loop iteration on the syntax tree
+// instead, as `make bench-loops` does for its comparison.
+#ifndef LOOP_VM
+#define LOOP_VM 1
+#endif
+
+// Run a while or do-while loop, given as the syntax tree the parser reads
+// loops into, from the current symbol values to the end. The loop is
+// compiled to register bytecode: every variable it touches is a register
+// while it runs, and the symbols of those declared outside it are written
+// back once, when it is done.
+//
+// Returns false, having changed nothing, if the loop uses something the
+// compiler leaves to the tree evaluator (an undefined name, or a body too
+// big for 16-bit operands). Otherwise *iterations_out is the number of
+// times the body ran.
+bool vm_run_loop(const Node *loop, ScopeStack *scope_stack,
+                 int *iterations_out);
+
+#endif // VM_H